@@ -0,0 +1,118 @@
+// ======================================================================== //
+// Copyright SCI Institute, University of Utah, 2018
+// ======================================================================== //
+
+#pragma once
+
+// keyframed camera paths for ospBrickBench -camera-path: one keyframe
+// per line, in the format the widget prints on the 'V' key
+//
+//   -vp <x y z> -vi <x y z> -vu <x y z> [-frames n] [-hold n]
+//
+// '-frames' is the number of frames the camera takes to move from the
+// previous keyframe to this one, '-hold' how many frames it may stay
+// there at most for the bricks of the view to arrive. empty lines and
+// lines starting with '#' are skipped
+
+#include "ospcommon/vec.h"
+// std
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ospray {
+
+  using namespace ospcommon;
+
+  struct CameraKeyframe
+  {
+    vec3f vp;
+    vec3f vi;
+    vec3f vu{0.f, 1.f, 0.f};
+    int frames;
+    int hold;
+  };
+
+  struct CameraPath
+  {
+    CameraPath(const std::string &fileName, int defaultFrames,
+               int defaultHold)
+    {
+      std::ifstream in(fileName);
+      if (!in)
+        throw std::runtime_error("could not open camera path " + fileName);
+      std::string line;
+      for (int lineNo = 1; std::getline(in, line); lineNo++) {
+        std::istringstream tokens(line);
+        std::string flag;
+        if (!(tokens >> flag) || flag[0] == '#')
+          continue;
+        CameraKeyframe k;
+        k.frames = defaultFrames;
+        k.hold   = defaultHold;
+        bool hasVp = false, hasVi = false;
+        do {
+          bool ok = true;
+          if (flag == "-vp") {
+            ok = bool(tokens >> k.vp.x >> k.vp.y >> k.vp.z);
+            hasVp = true;
+          } else if (flag == "-vi") {
+            ok = bool(tokens >> k.vi.x >> k.vi.y >> k.vi.z);
+            hasVi = true;
+          } else if (flag == "-vu") {
+            ok = bool(tokens >> k.vu.x >> k.vu.y >> k.vu.z);
+          } else if (flag == "-frames") {
+            ok = bool(tokens >> k.frames) && k.frames > 0;
+          } else if (flag == "-hold") {
+            ok = bool(tokens >> k.hold) && k.hold >= 0;
+          } else {
+            ok = false;
+          }
+          if (!ok)
+            throw std::runtime_error(fileName + ":" + std::to_string(lineNo)
+                                     + ": bad keyframe argument " + flag);
+        } while (tokens >> flag);
+        if (!hasVp || !hasVi)
+          throw std::runtime_error(fileName + ":" + std::to_string(lineNo)
+                                   + ": keyframe needs -vp and -vi");
+        keys.push_back(k);
+      }
+      if (keys.empty())
+        throw std::runtime_error("camera path " + fileName
+                                 + " has no keyframes");
+    }
+
+    /*! the camera 't' in [0,1] of the way from keyframe 'k-1' to 'k';
+        positions and focus points follow a Catmull-Rom spline through
+        the keyframes, the up vector is blended linearly */
+    CameraKeyframe at(size_t k, float t) const
+    {
+      const CameraKeyframe &k0 = keys[k > 1 ? k - 2 : 0];
+      const CameraKeyframe &k1 = keys[k - 1];
+      const CameraKeyframe &k2 = keys[k];
+      const CameraKeyframe &k3 = keys[std::min(k + 1, keys.size() - 1)];
+      CameraKeyframe c = k2;
+      c.vp = catmullRom(k0.vp, k1.vp, k2.vp, k3.vp, t);
+      c.vi = catmullRom(k0.vi, k1.vi, k2.vi, k3.vi, t);
+      const vec3f vu = (1.f - t) * k1.vu + t * k2.vu;
+      // opposite up vectors would cancel out halfway
+      c.vu = length(vu) > 1e-6f ? normalize(vu) : k2.vu;
+      return c;
+    }
+
+    static vec3f catmullRom(const vec3f &p0, const vec3f &p1,
+                            const vec3f &p2, const vec3f &p3, float t)
+    {
+      const float t2 = t * t, t3 = t2 * t;
+      return 0.5f * ((2.f * p1) + (p2 - p0) * t
+                     + (2.f * p0 - 5.f * p1 + 4.f * p2 - p3) * t2
+                     + (3.f * p1 - p0 - 3.f * p2 + p3) * t3);
+    }
+
+    std::vector<CameraKeyframe> keys;
+  };
+
+}
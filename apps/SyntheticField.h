@@ -0,0 +1,186 @@
+// ======================================================================== //
+// Copyright SCI Institute, University of Utah, 2018
+// ======================================================================== //
+
+#pragma once
+
+// procedural volumes for ospRaw2Bricks --synthetic: every voxel is
+// computed from its coordinates alone, so forests of any size can be
+// built block by block, in parallel, without an input file
+
+#include "ospcommon/vec.h"
+// std
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <string>
+
+namespace ospray {
+  namespace bt {
+
+    using namespace ospcommon;
+
+    struct SyntheticField
+    {
+      enum Kind { NOISE, MARSCHNER_LOBB, BLOBS, TURBULENCE };
+
+      /*! 'frequency' is in features across the volume's largest side:
+          noise lattice cells, blob cells, or the coarsest turbulence
+          octave. 'emptiness' is the fraction of blob cells without a
+          blob; 'spectrum' the slope of the turbulence energy spectrum,
+          E(k) ~ k^-spectrum */
+      SyntheticField(const std::string &kindName,
+                     const vec3i &dims,
+                     int seed = 0,
+                     float frequency = 8.f,
+                     float emptiness = 0.9f,
+                     float spectrum = 5.f/3.f)
+        : dims(dims),
+          seed(seed),
+          frequency(frequency),
+          emptiness(emptiness),
+          spectrum(spectrum)
+      {
+        if (kindName == "noise")
+          kind = NOISE;
+        else if (kindName == "marschner-lobb" || kindName == "ml")
+          kind = MARSCHNER_LOBB;
+        else if (kindName == "blobs")
+          kind = BLOBS;
+        else if (kindName == "turbulence")
+          kind = TURBULENCE;
+        else
+          throw std::runtime_error("unknown synthetic field '"+kindName+"'");
+        if (dims.x <= 0 || dims.y <= 0 || dims.z <= 0)
+          throw std::runtime_error("synthetic field needs positive dimensions");
+        if (frequency <= 0.f || emptiness < 0.f || emptiness > 1.f)
+          throw std::runtime_error("invalid synthetic field parameters");
+        scale = 1.f/std::max(dims.x,std::max(dims.y,dims.z));
+        // octaves down to two voxels per feature, so every level of a
+        // tree has detail to refine
+        numOctaves = 1;
+        while (frequency*(1 << numOctaves) <= 0.5f/scale && numOctaves < 24)
+          numOctaves++;
+        // a band of octave k carries energy E(k)*k, so its amplitude
+        // falls off as k^((1-spectrum)/2)
+        octaveGain = powf(2.f,0.5f*(1.f-spectrum));
+      }
+
+      /*! value in [0,1] of the voxel 'c' */
+      float operator()(const vec3i &c) const
+      {
+        // isotropic coordinates, in [0,1] along the largest side
+        const vec3f p = (vec3f(c)+vec3f(0.5f))*scale;
+        switch (kind) {
+        case NOISE:
+          return clamp01(0.5f+0.5f*noise(p*frequency,seed));
+        case MARSCHNER_LOBB:
+          return marschnerLobb(2.f*p-vec3f(1.f));
+        case BLOBS:
+          return blobs(p*frequency);
+        default:
+          return turbulence(p*frequency);
+        }
+      }
+
+      static float clamp01(float v)
+      { return std::min(1.f,std::max(0.f,v)); }
+
+      static uint32_t hash(int x, int y, int z, int seed)
+      {
+        uint32_t h = uint32_t(seed)*0x9E3779B9u;
+        h ^= uint32_t(x)*0x85EBCA6Bu; h = (h << 13) | (h >> 19);
+        h ^= uint32_t(y)*0xC2B2AE35u; h = (h << 13) | (h >> 19);
+        h ^= uint32_t(z)*0x27D4EB2Fu;
+        h ^= h >> 16; h *= 0x7FEB352Du;
+        h ^= h >> 15; h *= 0x846CA68Bu;
+        h ^= h >> 16;
+        return h;
+      }
+
+      /*! uniform in [0,1) from a hash */
+      static float unit(uint32_t h)
+      { return (h >> 8)*(1.f/16777216.f); }
+
+      /*! gradient noise in about [-1,1] on a unit lattice */
+      static float noise(const vec3f &p, int seed)
+      {
+        const vec3i i(int(floorf(p.x)),int(floorf(p.y)),int(floorf(p.z)));
+        const vec3f f = p-vec3f(i);
+        const vec3f s = f*f*f*(f*(f*6.f-vec3f(15.f))+vec3f(10.f));
+        float c[2][2][2];
+        for (int dz=0;dz<2;dz++)
+          for (int dy=0;dy<2;dy++)
+            for (int dx=0;dx<2;dx++) {
+              const vec3f d = f-vec3f(dx,dy,dz);
+              // the 12 cube edge directions, 4 of them twice
+              const uint32_t g = hash(i.x+dx,i.y+dy,i.z+dz,seed) & 15;
+              const float u = g < 8 ? d.x : d.y;
+              const float v = g < 4 ? d.y : (g == 12 || g == 14 ? d.x : d.z);
+              c[dz][dy][dx] = ((g & 1) ? -u : u) + ((g & 2) ? -v : v);
+            }
+        const float c00 = c[0][0][0]+s.x*(c[0][0][1]-c[0][0][0]);
+        const float c01 = c[0][1][0]+s.x*(c[0][1][1]-c[0][1][0]);
+        const float c10 = c[1][0][0]+s.x*(c[1][0][1]-c[1][0][0]);
+        const float c11 = c[1][1][0]+s.x*(c[1][1][1]-c[1][1][0]);
+        const float c0  = c00+s.y*(c01-c00);
+        const float c1  = c10+s.y*(c11-c10);
+        return c0+s.z*(c1-c0);
+      }
+
+      /*! the Marschner-Lobb test signal on [-1,1]^3 */
+      static float marschnerLobb(const vec3f &p)
+      {
+        const float fM = 6.f, alpha = 0.25f;
+        const float r  = sqrtf(p.x*p.x+p.y*p.y);
+        const float pr = cosf(2.f*float(M_PI)*fM*cosf(float(M_PI)*r/2.f));
+        return (1.f-sinf(float(M_PI)*p.z/2.f)+alpha*(1.f+pr))/(2.f*(1.f+alpha));
+      }
+
+      /*! at most one blob per lattice cell, at a random position and of
+          random size inside it; zero everywhere else */
+      float blobs(const vec3f &p) const
+      {
+        const vec3i i(int(floorf(p.x)),int(floorf(p.y)),int(floorf(p.z)));
+        const uint32_t h = hash(i.x,i.y,i.z,seed);
+        if (unit(h) < emptiness)
+          return 0.f;
+        const float radius = 0.15f+0.3f*unit(hash(i.x,i.y,i.z,seed+1));
+        const vec3f center = vec3f(i)+vec3f(0.5f)
+          +(0.5f-radius)*vec3f(2.f*unit(hash(i.x,i.y,i.z,seed+2))-1.f,
+                               2.f*unit(hash(i.x,i.y,i.z,seed+3))-1.f,
+                               2.f*unit(hash(i.x,i.y,i.z,seed+4))-1.f);
+        const vec3f d = (p-center)*(1.f/radius);
+        const float r2 = dot(d,d);
+        if (r2 >= 1.f)
+          return 0.f;
+        return (1.f-r2)*(1.f-r2);
+      }
+
+      /*! octaves of gradient noise down to the voxel scale, with
+          amplitudes following the energy spectrum */
+      float turbulence(const vec3f &p) const
+      {
+        float sum = 0.f, norm = 0.f, amplitude = 1.f, f = 1.f;
+        for (int o=0;o<numOctaves;o++) {
+          sum  += amplitude*noise(p*f,seed+o);
+          norm += amplitude;
+          amplitude *= octaveGain;
+          f *= 2.f;
+        }
+        return clamp01(0.5f+0.5f*sum/norm);
+      }
+
+      Kind  kind;
+      vec3i dims;
+      int   seed;
+      float frequency;
+      float emptiness;
+      float spectrum;
+      float scale;
+      int   numOctaves;
+      float octaveGain;
+    };
+
+  }
+}
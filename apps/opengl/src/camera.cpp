@@ -3,8 +3,15 @@
 // ======================================================================== //
 #include "camera.h"
 #include "ospcommon/AffineSpace.h"
+#include <chrono>
 using namespace ospcommon;
-viewer::Camera::Camera(viewer::CameraProp& p) : prop(p) {}
+static double Seconds()
+{
+  using namespace std::chrono;
+  return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+viewer::Camera::Camera(viewer::CameraProp& p) 
+  : prop(p), velocity(0.f), dirVelocity(0.f) {}
 vec2f viewer::Camera::mouse2screen(const int& x, const int& y, 
                                    const float& width,
                                    const float& height) 
@@ -33,6 +40,42 @@ vec3f  viewer::Camera::CameraDir()
 {
   return -xfmVector(this->ball.Matrix().l, vec3f(0, 0, -CameraFocalLength()));
 }
+float  viewer::Camera::CameraFovy() { return this->fovy; }
+float  viewer::Camera::CameraAspect() { return this->aspect; }
+bool   viewer::Camera::CameraPredict(const float& dt, vec3f& pos, vec3f& dir)
+{
+  if (motionTime < 0.0 || Seconds() - motionTime > motionIdle) {
+    return false;
+  }
+  if (length(velocity) == 0.f && length(dirVelocity) == 0.f) {
+    return false;
+  }
+  pos = motionPos + dt * velocity;
+  dir = normalize(motionDir + dt * dirVelocity);
+  return true;
+}
+void   viewer::Camera::CameraTrackMotion(const vec3f& pos, const vec3f& dir)
+{
+  const double now = Seconds();
+  const vec3f ndir = normalize(dir);
+  if (motionTime >= 0.0) {
+    const float dt = (float)(now - motionTime);
+    // several events can arrive within one frame, wait for a usable step
+    if (dt < 1e-3f) { return; }
+    if (dt > motionIdle) {
+      // restarting from rest, don't blend with the old motion
+      velocity    = (pos - motionPos) / dt;
+      dirVelocity = (ndir - motionDir) / dt;
+    } else {
+      const float a = 0.5f;
+      velocity    = (1.f - a) * velocity    + a * (pos - motionPos) / dt;
+      dirVelocity = (1.f - a) * dirVelocity + a * (ndir - motionDir) / dt;
+    }
+  }
+  motionPos  = pos;
+  motionDir  = ndir;
+  motionTime = now;
+}
 void   viewer::Camera::CameraBeginZoom(const float& x, const float& y) {
   const vec2f p = mouse2screen(x, y, this->width, this->height);
   this->ball.BeginZoom(p.x, p.y);
@@ -93,6 +136,7 @@ void viewer::Camera::SetViewPort(const vec3f& vp, const vec3f& vu,
   prop.SetDir(this->focus - this->eye);
   prop.SetPos(this->eye);
   //prop.SetFovy(this->fovy/this->ball.ZoomRatio());
+  CameraTrackMotion(this->eye, this->focus - this->eye);
   this->ball.SetCoordinate(this->up, 
                            this->focus - this->eye,
                            this->eye);
@@ -121,6 +165,7 @@ void viewer::Camera::CameraUpdateView()
   prop.SetDir(dir);
   prop.SetUp(up);
   //prop.SetFovy(this->fovy/this->ball.ZoomRatio());
+  CameraTrackMotion(pos, dir);
 }
 void viewer::Camera::CameraUpdateProj(const size_t& width, 
                                       const size_t& height) 
@@ -26,6 +26,16 @@ namespace viewer {
     ospcommon::vec3f up;    // y axis as the initial up vector !!!!
     viewer::Trackball ball;
     viewer::CameraProp& prop;
+    // camera motion, sampled on every view update and smoothed so the
+    // camera path can be extrapolated for prefetching
+    ospcommon::vec3f motionPos;
+    ospcommon::vec3f motionDir;
+    ospcommon::vec3f velocity;    // world units per second
+    ospcommon::vec3f dirVelocity; // change of the unit view direction per second
+    double motionTime = -1.0;
+    const double motionIdle = 0.25; // seconds without an update = stopped
+    void CameraTrackMotion(const ospcommon::vec3f& pos,
+                           const ospcommon::vec3f& dir);
   public:
     Camera(viewer::CameraProp& p);
     void SetSize(const size_t& w, const size_t& h);
@@ -41,6 +51,13 @@ namespace viewer {
     ospcommon::vec3f CameraPos();
     ospcommon::vec3f CameraUp();
     ospcommon::vec3f CameraDir();
+    float  CameraFovy();
+    float  CameraAspect();
+    // extrapolate the camera 'dt' seconds ahead along its recent motion,
+    // returns false when the camera is not moving
+    bool   CameraPredict(const float& dt,
+                         ospcommon::vec3f& pos,
+                         ospcommon::vec3f& dir);
     void   CameraBeginZoom(const float& x, const float& y);
     void   CameraZoom(const float& x, const float& y);
     void   CameraBeginDrag(const float& x, const float& y);
@@ -3,6 +3,7 @@
 // ======================================================================== //
 #include "engine.h"
 #include "scene/properties.h"
+#include <algorithm>
 void viewer::Engine::Validate()
 {
   if (fbState == ExecState::INVALID)
@@ -14,6 +15,7 @@ void viewer::Engine::Start() {
     return;
   // start the thread
   fbState = ExecState::RUNNING;
+  metric_last_frame = std::chrono::high_resolution_clock::now();
   fbThread = ospcommon::make_unique<std::thread>([&] {
       while (fbState != ExecState::STOPPED) {
         // check if we need to resize
@@ -34,14 +36,38 @@ void viewer::Engine::Start() {
                                     OSP_FB_COLOR | OSP_FB_ACCUM);
           ospFrameBufferClear(ospFB, OSP_FB_COLOR | OSP_FB_ACCUM);
           ospFBPtr = (uint32_t *) ospMapFrameBuffer(ospFB, OSP_FB_COLOR);
+          fbAccumFrames = 0;
+          // the volume's LOD table depends on the framebuffer size
+          if (ospVol != nullptr) {
+            ospSet2i(ospVol, "imageSize", size.x, size.y);
+            ospCommit(ospVol);
+          }
+        }
+        // adjust level of detail
+        const bool cameraMoved = viewer::widgets::Commit();
+        UpdateLOD(cameraMoved);
+        // new bricks arrived, coarse samples in the accumulation are stale
+        if (fbResidencyGeneration) {
+          const size_t generation = fbResidencyGeneration();
+          if (generation != fbGeneration) {
+            fbGeneration = generation;
+            fbClear = true;
+          }
         }
         // clear a frame
-        if (fbClear || viewer::widgets::Commit()) {
+        if (fbClear || cameraMoved) {
           fbClear = false;
+          fbAccumFrames = 0;
           ospFrameBufferClear(ospFB, OSP_FB_COLOR | OSP_FB_ACCUM);
         }
+        // nothing left to refine, stop rendering until something changes
+        if (IsConverged()) {
+          std::this_thread::sleep_for(std::chrono::milliseconds(10));
+          continue;
+        }
         // render a frame
         ospRenderFrame(ospFB, ospRen, OSP_FB_COLOR | OSP_FB_ACCUM);
+        ++fbAccumFrames;
         // map
         auto *srcPB = (uint32_t*)ospFBPtr;
         auto *dstPB = (uint32_t*)fbBuffers.back().data();
@@ -84,6 +110,47 @@ void viewer::Engine::Init(size_t width, size_t height, OSPRenderer ren)
   Resize(width, height); 
   ospRen = ren;
 }
+void viewer::Engine::SetVolume(OSPVolume vol, float targetFPS)
+{
+  ospVol = vol;
+  lod_target_fps = targetFPS;
+}
+void viewer::Engine::SetResidency(std::function<size_t()> generation,
+                                  std::function<size_t()> pending)
+{
+  fbResidencyGeneration = generation;
+  fbPendingBricks = pending;
+}
+bool viewer::Engine::IsConverged()
+{
+  if (!fbPendingBricks)
+    return false;
+  return fbAccumFrames >= fbConvergedFrames && fbPendingBricks() == 0;
+}
+void viewer::Engine::UpdateLOD(bool cameraMoved)
+{
+  if (ospVol == nullptr || lod_target_fps <= 0.f)
+    return;
+  float bias = lod_bias;
+  if (cameraMoved) {
+    lod_still_frames = 0;
+    // multiplicative increase when too slow, slow decay when fast enough
+    const double targetTime = 1.0 / lod_target_fps;
+    if (metric_frame_time > 1.1 * targetTime) {
+      bias = std::min(lod_max_bias, bias * 1.25f);
+    } else if (metric_frame_time < 0.7 * targetTime) {
+      bias = std::max(1.f, bias / 1.1f);
+    }
+  } else if (++lod_still_frames >= lod_relax_frames) {
+    bias = 1.f;
+  }
+  if (bias != lod_bias) {
+    lod_bias = bias;
+    ospSet1f(ospVol, "lodBias", lod_bias);
+    ospCommit(ospVol);
+    fbClear = true;
+  }
+}
 void viewer::Engine::Clear() 
 {
   fbClear = true;
@@ -18,6 +18,7 @@
 #include <vector>
 #include <memory>
 #include <chrono>
+#include <functional>
 
 using namespace ospcommon;
 namespace viewer {  
@@ -35,15 +36,38 @@ namespace viewer {
     ospcommon::utility::DoubleBufferedValue<std::vector<uint32_t>> 
       fbBuffers;
     int fbNumPixels{0};
+    size_t fbAccumFrames{0};
+  private:
+    // progressive refinement: accumulation is restarted whenever the
+    // residency generation changes (new bricks became resident), and
+    // rendering pauses once the image is converged with nothing pending
+    const size_t fbConvergedFrames = 64;
+    size_t fbGeneration{0};
+    std::function<size_t()> fbResidencyGeneration;
+    std::function<size_t()> fbPendingBricks;
+    bool IsConverged();
   private:
     uint32_t      *ospFBPtr;
     OSPFrameBuffer ospFB  = nullptr;
     OSPRenderer    ospRen = nullptr;
+    OSPVolume      ospVol = nullptr;
   private:
     std::chrono::high_resolution_clock::time_point metric_time;
+    std::chrono::high_resolution_clock::time_point metric_last_frame;
     const size_t metric_frame_step = 10;
     size_t       metric_frames     = 0;
     double       metric_fps        = 0.;
+    double       metric_frame_time = 0.;
+  private:
+    // closed-loop LOD controller: while the camera moves, the volume's
+    // 'lodBias' is adjusted to hold lod_target_fps; once the camera has
+    // been still for lod_relax_frames frames it goes back to full detail
+    const size_t lod_relax_frames = 3;
+    const float  lod_max_bias     = 64.f;
+    float        lod_target_fps   = 0.f;
+    float        lod_bias         = 1.f;
+    size_t       lod_still_frames = 0;
+    void UpdateLOD(bool cameraMoved);
   public:
     void Validate();
     void Start();
@@ -53,6 +77,9 @@ namespace viewer {
     void UnmapFramebuffer();
     void Resize(size_t width, size_t height);
     void Init(size_t width, size_t height, OSPRenderer ren);
+    void SetVolume(OSPVolume vol, float targetFPS);
+    void SetResidency(std::function<size_t()> generation,
+                      std::function<size_t()> pending);
     void Clear();
     void Delete();
     void ResetFPS() 
@@ -62,6 +89,11 @@ namespace viewer {
     }
     void CountFPS()
     {
+      const auto now = std::chrono::high_resolution_clock::now();
+      metric_frame_time =
+        std::chrono::duration_cast<std::chrono::duration<double>>
+        (now - metric_last_frame).count();
+      metric_last_frame = now;
       ++ metric_frames;
       if ((metric_frames % metric_frame_step) == 0) {
         const auto t = std::chrono::high_resolution_clock::now();
@@ -73,6 +105,8 @@ namespace viewer {
       }      
     }
     double GetFPS() const { return metric_fps; }
+    double GetFrameTime() const { return metric_frame_time; }
+    float  GetLODBias() const { return lod_bias; }
   };
 };
 #endif //OSPRAY_ENGINE_H
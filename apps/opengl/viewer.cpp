@@ -48,6 +48,9 @@ static inline void _glCheckError
 #include "camera.h"
 #include "engine.h"
 #include "ospcommon/vec.h"
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 // ======================================================================== //
 using namespace viewer;
 static affine3f Identity(vec3f(1, 0, 0),
@@ -68,6 +71,28 @@ static TransferFunctionProp     tfnProp;
 
 static Engine engine;
 static Camera camera(camProp);
+
+// ======================================================================== //
+static std::function<void(const osp::vec3f&, const osp::vec3f&,
+                          float, float)> prefetchFn;
+static std::function<void()> cancelPrefetchFn;
+static const float  prefetchLookahead = 0.5f; // seconds
+static const double prefetchInterval  = 0.1;  // seconds
+
+// prefetchFn walks the forest's frustum, far too slow for the ui thread:
+// PrefetchUpdate only leaves its latest request in this slot and a worker
+// issues it. requests the worker hasn't picked up yet are replaced
+struct PrefetchRequest {
+  enum { NONE, PREFETCH, CANCEL } kind = NONE;
+  osp::vec3f pos, dir;
+  float fovy = 0.f, aspect = 0.f;
+};
+static PrefetchRequest         prefetchRequest;
+static std::mutex              prefetchMutex;
+static std::condition_variable prefetchCond;
+static std::thread             prefetchThread;
+static bool                    prefetchQuit = false;
+
 bool viewer::widgets::Commit() {
   bool update = false;
   if (camProp.Commit()) { update = true; }
@@ -158,6 +183,7 @@ void WidgetDraw() {
                      ImGuiWindowFlags_NoSavedSettings))
     {
       ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f),"FPS: %s", std::to_string(engine.GetFPS()).c_str());
+      ImGui::TextColored(ImVec4(0.0f, 0.0f, 1.0f, 1.0f),"LOD bias: %s", std::to_string(engine.GetLODBias()).c_str());
     }
     ImGui::End();
     ImGui::PopStyleColor();
@@ -228,6 +254,22 @@ namespace viewer {
   {
     tfnProp.Create(t, a, b);
   };
+  void Handler(OSPVolume v, const float &targetFPS)
+  {
+    engine.SetVolume(v, targetFPS);
+  };
+  void Handler(std::function<size_t()> residencyGeneration,
+               std::function<size_t()> pendingBricks)
+  {
+    engine.SetResidency(residencyGeneration, pendingBricks);
+  };
+  void Handler(std::function<void(const osp::vec3f&, const osp::vec3f&,
+                                  float, float)> prefetch,
+               std::function<void()> cancel)
+  {
+    prefetchFn = prefetch;
+    cancelPrefetchFn = cancel;
+  };
 }; // namespace viewer
 
 // ======================================================================== //
@@ -371,6 +413,75 @@ void window_size_callback(GLFWwindow *window, int width, int height)
 // ======================================================================== //
 //
 // ======================================================================== //
+static void PostPrefetch(const PrefetchRequest &request)
+{
+  {
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    prefetchRequest = request;
+  }
+  prefetchCond.notify_one();
+}
+static void PrefetchStart()
+{
+  if (!prefetchFn || prefetchThread.joinable()) { return; }
+  prefetchQuit = false;
+  prefetchThread = std::thread([] {
+    std::unique_lock<std::mutex> lock(prefetchMutex);
+    while (true) {
+      prefetchCond.wait(lock, [] {
+        return prefetchQuit || prefetchRequest.kind != PrefetchRequest::NONE;
+      });
+      if (prefetchQuit) { return; }
+      const PrefetchRequest request = prefetchRequest;
+      prefetchRequest.kind = PrefetchRequest::NONE;
+      lock.unlock();
+      if (request.kind == PrefetchRequest::PREFETCH) {
+        prefetchFn(request.pos, request.dir, request.fovy, request.aspect);
+      } else if (cancelPrefetchFn) {
+        cancelPrefetchFn();
+      }
+      lock.lock();
+    }
+  });
+}
+static void PrefetchStop()
+{
+  if (!prefetchThread.joinable()) { return; }
+  {
+    std::lock_guard<std::mutex> lock(prefetchMutex);
+    prefetchQuit = true;
+  }
+  prefetchCond.notify_one();
+  prefetchThread.join();
+}
+static void PrefetchUpdate()
+{
+  // each issued prediction replaces the previous one, so a wrong guess
+  // only costs the bricks already picked up by the loader
+  static bool prefetching = false;
+  static double lastIssue = 0.0;
+  if (!prefetchFn) { return; }
+  vec3f pos, dir;
+  if (camera.CameraPredict(prefetchLookahead, pos, dir)) {
+    const double now = glfwGetTime();
+    if (now - lastIssue >= prefetchInterval) {
+      PrefetchRequest request;
+      request.kind   = PrefetchRequest::PREFETCH;
+      request.pos    = osp::vec3f{pos.x, pos.y, pos.z};
+      request.dir    = osp::vec3f{dir.x, dir.y, dir.z};
+      request.fovy   = camera.CameraFovy();
+      request.aspect = camera.CameraAspect();
+      PostPrefetch(request);
+      lastIssue = now;
+      prefetching = true;
+    }
+  } else if (prefetching) {
+    PrefetchRequest request;
+    request.kind = PrefetchRequest::CANCEL;
+    PostPrefetch(request);
+    prefetching = false;
+  }
+}
 void RenderWindow(GLFWwindow *window)
 {
   // Init
@@ -378,10 +489,12 @@ void RenderWindow(GLFWwindow *window)
   WidgetInit(window);
   // Start
   engine.Start();
+  PrefetchStart();
   while (!glfwWindowShouldClose(window)) {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     {
       key_onhold_callback(window);
+      PrefetchUpdate();
       /* copy rendered buffer */
       if (engine.HasNewFrame()) {
         auto &mapped = engine.MapFramebuffer();
@@ -411,6 +524,7 @@ void RenderWindow(GLFWwindow *window)
     glfwPollEvents();
   }
   // ShutDown
+  PrefetchStop();
   engine.Stop();
   WidgetStop();
   glfwDestroyWindow(window);
@@ -7,6 +7,7 @@
 
 #include "ospray/ospray.h"
 #include <string>
+#include <functional>
 
 namespace viewer {
   int  Init(const int ac, const char** av,
@@ -20,6 +21,15 @@ namespace viewer {
 	       const osp::vec3f& vi);
   void Handler(OSPTransferFunction tfn, 
                const float& min, const float& max);
+  void Handler(OSPVolume volume, const float& targetFPS);
+  void Handler(std::function<size_t()> residencyGeneration,
+               std::function<size_t()> pendingBricks);
+  // prefetch(pos, dir, fovy, aspect) is called with the camera
+  // extrapolated along its recent motion while it moves, cancel()
+  // once it stops; both run on a worker thread, never the ui thread
+  void Handler(std::function<void(const osp::vec3f&, const osp::vec3f&,
+                                  float, float)> prefetch,
+               std::function<void()> cancel);
 
 };
 
@@ -0,0 +1,858 @@
+// ======================================================================== //
+// Copyright SCI Institute, University of Utah, 2018
+// ======================================================================== //
+
+// times the bricktree kernels one at a time instead of whole frames: the
+// c++ tree descent (BrickTree::findValue), the c++ sampler
+// (BrickTreeForestSampler::sample), the ispc sample, gradient and ray
+// step functions of BrickTreeVolume, and its sorted wavefront sampling
+// (computeSamples) next to the per-sample one. each runs on a single
+// thread over a fixed set of positions or rays (coherent rays, random
+// points, points on tree borders) of a synthetic forest that is fully
+// resident and whose loaders are stopped, so nothing but the kernel
+// itself is measured; each config's forest is freed before the next one
+// is built, so configs do not affect each other. results are ns per
+// sample (or step) and the bytes of bricks each one touches, optionally
+// as json
+
+#include "ospray/ospray.h"
+#include "ospray/BrickTreeVolume.h"
+#include "common/helper.h"
+#include "ospBrickTreeTools.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+#include <unistd.h>
+#include <unordered_set>
+#include <vector>
+
+using namespace ospcommon;
+using namespace ospray::bt;
+
+static void usage(const std::string &msg = "")
+{
+  if (msg != "")
+    std::cout << "Error: " << msg << std::endl << std::endl;
+  std::cout << "Usage" << std::endl;
+  std::cout << "  ./ospBrickMicroBench <args>" << std::endl;
+  std::cout << "with args:" << std::endl;
+  std::cout << " -config <N> <depth> : brick size and tree depth to run, may be"
+               " repeated (default: 2 6, 4 3, 8 2)" << std::endl;
+  std::cout << " -grid <x> <y> <z>   : trees of the forest (default: 2 2 2)"
+            << std::endl;
+  std::cout << " -count <n>          : samples per pattern (default: 262144)"
+            << std::endl;
+  std::cout << " -rays <n>           : rays per pattern (default: 4096)"
+            << std::endl;
+  std::cout << " -step <dt>          : ray step (default: 1)" << std::endl;
+  std::cout << " -repeat <n>         : timed runs per kernel (default: 5)"
+            << std::endl;
+  std::cout << " -seed <s>           : seed of the random patterns (default: 1)"
+            << std::endl;
+  std::cout << " -dir <dir>          : where the forests are written "
+               "(default: a temporary directory)" << std::endl;
+  std::cout << " -json <file>        : also write the results as json"
+            << std::endl;
+  exit(msg != "");
+}
+
+struct BenchConfig
+{
+  int N;
+  int depth;
+};
+
+struct BenchResult
+{
+  std::string kernel;
+  std::string pattern;
+  std::string unit;  // what one item is, "sample" or "step"
+  size_t items;
+  double nsMin;
+  double nsMedian;
+  double bytesPerItem;
+  size_t workingSetBytes;
+};
+
+/*! the synthetic volume: smooth, so every brick holds a spread of values */
+static float syntheticField(const vec3i &p)
+{
+  return 0.5f + 0.5f * sinf(0.11f * p.x) * sinf(0.07f * p.y + 1.f)
+                     * sinf(0.05f * p.z + 2.f);
+}
+
+/*! a full bricktree over syntheticField: every cell of every level is
+    refined, so every lookup descends to the leaves */
+template<int N>
+struct SyntheticTree
+{
+  typedef typename BrickTree<N, float>::ValueBrick ValueBrick;
+  typedef typename BrickTree<N, float>::IndexBrick IndexBrick;
+
+  SyntheticTree(const vec3i &origin, int blockWidth)
+  {
+    float lo, hi;
+    build(origin, blockWidth, 0, avgValue, lo, hi);
+    valueRange = vec2f(lo, hi);
+  }
+
+  /*! build the brick covering 'width' voxels from 'origin'; returns its ID */
+  int build(const vec3i &origin, int width, int level,
+            float &avg, float &lo, float &hi)
+  {
+    const int brickID = valueBricks.size();
+    valueBricks.emplace_back();
+    indexBrickOf.push_back(BrickTree<N, float>::invalidID());
+    brickLevel.push_back(level);
+
+    ValueBrick vb;
+    const int cellWidth = width / N;
+    int indexBrickID = BrickTree<N, float>::invalidID();
+    if (cellWidth > 1) {
+      indexBrickID = indexBricks.size();
+      indexBricks.emplace_back();
+      indexBrickOf[brickID] = indexBrickID;
+    }
+    lo = std::numeric_limits<float>::infinity();
+    hi = -lo;
+    double sum = 0.0;
+    for (int iz = 0; iz < N; iz++)
+      for (int iy = 0; iy < N; iy++)
+        for (int ix = 0; ix < N; ix++) {
+          const vec3i cell = origin + vec3i(ix, iy, iz) * cellWidth;
+          float v, cellLo, cellHi;
+          if (indexBrickID < 0) {
+            v = cellLo = cellHi = syntheticField(cell);
+          } else {
+            const int childID = build(cell, cellWidth, level + 1,
+                                      v, cellLo, cellHi);
+            indexBricks[indexBrickID].childID[iz][iy][ix] = childID;
+          }
+          vb.value[iz][iy][ix] = v;
+          lo = std::min(lo, cellLo);
+          hi = std::max(hi, cellHi);
+          sum += v;
+        }
+    vb.vRange[0] = lo;
+    vb.vRange[1] = hi;
+    valueBricks[brickID] = vb;
+    avg = sum / (N * N * N);
+    return brickID;
+  }
+
+  /*! write the tree's .osp and .ospbin files like ospRaw2Bricks does;
+      returns its manifest entry */
+  BrickTreeManifestEntry save(const std::string &ospFileName,
+                              const vec3i &validSize, int depth) const
+  {
+    const std::string binFileName = ospFileName + "bin";
+    FILE *bin = fopen(binFileName.c_str(), "wb");
+    if (!bin)
+      throw std::runtime_error("could not write " + binFileName);
+    const size_t indexOfs = 0;
+    const size_t valueOfs = indexOfs + indexBricks.size() * sizeof(IndexBrick);
+    const size_t indexBrickOfOfs = valueOfs + valueBricks.size() * sizeof(ValueBrick);
+    if (fwrite(indexBricks.data(), sizeof(IndexBrick), indexBricks.size(), bin)
+          != indexBricks.size()
+        || fwrite(valueBricks.data(), sizeof(ValueBrick), valueBricks.size(), bin)
+          != valueBricks.size()
+        || fwrite(indexBrickOf.data(), sizeof(int32_t), indexBrickOf.size(), bin)
+          != indexBrickOf.size())
+      throw std::runtime_error("could not write " + binFileName);
+    fclose(bin);
+
+    FILE *osp = fopen(ospFileName.c_str(), "w");
+    if (!osp)
+      throw std::runtime_error("could not write " + ospFileName);
+    fprintf(osp, "<?xml?>\n");
+    fprintf(osp, "<ospray>\n");
+    fprintf(osp, "  <BrickTree\n");
+    fprintf(osp, "    averageValue=\"%f\"\n", avgValue);
+    fprintf(osp, "    valueRange=\"%f %f\"\n", valueRange.x, valueRange.y);
+    fprintf(osp, "    format=\"float\"\n");
+    fprintf(osp, "    brickSize=\"%i\"\n", N);
+    fprintf(osp, "    validSize=\"%i %i %i\"\n",
+            validSize.x, validSize.y, validSize.z);
+    fprintf(osp, "    >\n");
+    fprintf(osp, "    <indexBricks num=\"%li\" ofs=\"%li\"/>\n",
+            indexBricks.size(), indexOfs);
+    fprintf(osp, "    <valueBricks num=\"%li\" ofs=\"%li\"/>\n",
+            valueBricks.size(), valueOfs);
+    fprintf(osp, "    <indexBrickOf num=\"%li\" ofs=\"%li\"/>\n",
+            indexBrickOf.size(), indexBrickOfOfs);
+    fprintf(osp, "  </BrickTree>\n");
+    fprintf(osp, "</ospray>\n");
+    fclose(osp);
+
+    BrickTreeManifestEntry e;
+    e.numValueBricks  = valueBricks.size();
+    e.numIndexBricks  = indexBricks.size();
+    e.numBrickInfos   = indexBrickOf.size();
+    e.indexBricksOfs  = indexOfs;
+    e.valueBricksOfs  = valueOfs;
+    e.indexBrickOfOfs = indexBrickOfOfs;
+    e.avgValue        = avgValue;
+    e.nBrickSize      = N;
+    e.valueRange[0]   = valueRange.x;
+    e.valueRange[1]   = valueRange.y;
+    e.validSize[0]    = validSize.x;
+    e.validSize[1]    = validSize.y;
+    e.validSize[2]    = validSize.z;
+    e.depth           = depth;
+    stampManifestEntry(e, binFileName);
+    return e;
+  }
+
+  std::vector<ValueBrick> valueBricks;
+  std::vector<IndexBrick> indexBricks;
+  std::vector<int32_t> indexBrickOf;
+  std::vector<int> brickLevel;
+  float avgValue;
+  vec2f valueRange;
+};
+
+/*! write a forest of 'gridSize' full trees under 'base': the toplevel
+    .osp, every tree's files, the manifest, and a residency snapshot of
+    all bricks so the volume opens with the whole forest resident.
+    returns the forest's value range */
+template<int N>
+static vec2f writeForest(const std::string &base, int depth,
+                         const vec3i &gridSize, size_t &numBricks,
+                         std::vector<std::string> &files)
+{
+  const BrickLevelTable levels(N, 1 << (depth * log2PowerOf2(N)));
+  const int blockWidth = 1 << levels.blockShift;
+  const vec3i validSize = gridSize * blockWidth;
+  const int numTrees = gridSize.product();
+
+  std::vector<BrickTreeManifestEntry> entries(numTrees);
+  std::vector<std::vector<PrefetchBrick>> treeBricks(numTrees);
+  tasking::parallel_for(numTrees, [&](int treeID) {
+    const vec3i treePos(treeID % gridSize.x,
+                        (treeID / gridSize.x) % gridSize.y,
+                        treeID / (gridSize.x * gridSize.y));
+    SyntheticTree<N> t(treePos * blockWidth, blockWidth);
+    char name[base.size() + 100];
+    sprintf(name, "%s-brick%06i.osp", base.c_str(), treeID);
+    entries[treeID] = t.save(name, vec3i(blockWidth), levels.depth);
+    for (size_t b = 0; b < t.valueBricks.size(); b++)
+      treeBricks[treeID].push_back({treeID, int(b), t.brickLevel[b]});
+  });
+
+  vec2f range(std::numeric_limits<float>::infinity(),
+              -std::numeric_limits<float>::infinity());
+  std::vector<PrefetchBrick> bricks;
+  for (int treeID = 0; treeID < numTrees; treeID++) {
+    char name[base.size() + 100];
+    sprintf(name, "%s-brick%06i.osp", base.c_str(), treeID);
+    files.push_back(name);
+    files.push_back(std::string(name) + "bin");
+    range.x = std::min(range.x, entries[treeID].valueRange[0]);
+    range.y = std::max(range.y, entries[treeID].valueRange[1]);
+    bricks.insert(bricks.end(), treeBricks[treeID].begin(),
+                  treeBricks[treeID].end());
+  }
+  numBricks = bricks.size();
+
+  const std::string ospFileName = base + ".osp";
+  FILE *osp = fopen(ospFileName.c_str(), "w");
+  if (!osp)
+    throw std::runtime_error("could not write " + ospFileName);
+  fprintf(osp, "<?xml?>\n");
+  fprintf(osp, "<ospray>\n");
+  fprintf(osp, "<MultiBrickTree\n");
+  fprintf(osp, "   gridSize=\"%i %i %i\"\n", gridSize.x, gridSize.y, gridSize.z);
+  fprintf(osp, "   format=\"float\"\n");
+  fprintf(osp, "   brickSize=\"%i\"\n", N);
+  fprintf(osp, "   blockWidth=\"%i\"\n", blockWidth);
+  fprintf(osp, "   validSize=\"%i %i %i\"\n",
+          validSize.x, validSize.y, validSize.z);
+  fprintf(osp, "\t/>\n");
+  fprintf(osp, "</ospray>\n");
+  fclose(osp);
+  files.push_back(ospFileName);
+
+  const std::string manifest = manifestFileName(FileName(ospFileName).dropExt());
+  const BrickTreeManifestHeader header =
+    BrickTreeManifestHeader::make(numTrees, N, sizeof(float));
+  writeManifestFile(manifest, header, entries);
+  files.push_back(manifest);
+
+  const std::string snapshot = base + ".residency";
+  const ResidencySnapshotHeader snapshotHeader =
+    ResidencySnapshotHeader::make(numTrees, N, sizeof(float), bricks.size());
+  FILE *out = fopen(snapshot.c_str(), "wb");
+  if (!out)
+    throw std::runtime_error("could not write " + snapshot);
+  const bool ok =
+    fwrite(&snapshotHeader, sizeof(snapshotHeader), 1, out) == 1
+    && fwrite(bricks.data(), sizeof(PrefetchBrick), bricks.size(), out)
+       == bricks.size();
+  if (fclose(out) != 0 || !ok)
+    throw std::runtime_error("could not write " + snapshot);
+  files.push_back(snapshot);
+  return range;
+}
+
+/*! the positions and rays one access pattern consists of */
+struct Pattern
+{
+  std::string name;
+  std::vector<vec3f> pos;
+  std::vector<vec3f> rayOrg;
+  std::vector<vec3f> rayDir;
+  std::vector<vec2f> rayRange;
+
+  void addRay(const box3f &box, const vec3f &org, const vec3f &dir)
+  {
+    float t0 = -std::numeric_limits<float>::infinity();
+    float t1 = std::numeric_limits<float>::infinity();
+    for (int a = 0; a < 3; a++) {
+      if (dir[a] == 0.f) {
+        if (org[a] < box.lower[a] || org[a] > box.upper[a])
+          return;
+        continue;
+      }
+      float ta = (box.lower[a] - org[a]) / dir[a];
+      float tb = (box.upper[a] - org[a]) / dir[a];
+      if (ta > tb)
+        std::swap(ta, tb);
+      t0 = std::max(t0, ta);
+      t1 = std::min(t1, tb);
+    }
+    if (t0 >= t1)
+      return;
+    rayOrg.push_back(org);
+    rayDir.push_back(dir);
+    rayRange.push_back(vec2f(t0, t1));
+  }
+};
+
+static vec3f randomDir(std::mt19937 &rng)
+{
+  std::normal_distribution<float> normal;
+  vec3f d;
+  do {
+    d = vec3f(normal(rng), normal(rng), normal(rng));
+  } while (dot(d, d) < 1e-6f);
+  return normalize(d);
+}
+
+/*! parallel rays in 8x8 tiles, the order a renderer casts them in;
+    the samples are taken at unit steps along them */
+static Pattern coherentPattern(const box3f &box, size_t count, size_t numRays)
+{
+  Pattern p;
+  p.name = "coherent";
+  const vec3f dir    = normalize(vec3f(0.3f, 0.2f, 1.f));
+  const vec3f u      = normalize(cross(dir, vec3f(0.f, 1.f, 0.f)));
+  const vec3f v      = cross(u, dir);
+  const vec3f center = box.center();
+  const float radius = 0.5f * length(box.size());
+  const int side = std::max(8, (int(sqrtf(float(numRays))) + 7) / 8 * 8);
+  for (int ty = 0; ty < side; ty += 8)
+    for (int tx = 0; tx < side; tx += 8)
+      for (int y = ty; y < ty + 8; y++)
+        for (int x = tx; x < tx + 8; x++) {
+          const float s = (x + 0.5f) / side * 2.f - 1.f;
+          const float t = (y + 0.5f) / side * 2.f - 1.f;
+          p.addRay(box, center + radius * (s * u + t * v), dir);
+        }
+  if (p.rayOrg.empty())
+    throw std::runtime_error("no coherent ray hits the volume");
+  for (size_t r = 0; p.pos.size() < count; r = (r + 1) % p.rayOrg.size())
+    for (float t = p.rayRange[r].x; t <= p.rayRange[r].y && p.pos.size() < count;
+         t += 1.f)
+      p.pos.push_back(p.rayOrg[r] + t * p.rayDir[r]);
+  return p;
+}
+
+/*! uniformly distributed points, and rays from random points inside in
+    random directions */
+static Pattern randomPattern(const box3f &box, size_t count, size_t numRays,
+                             int seed)
+{
+  Pattern p;
+  p.name = "random";
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<float> x(box.lower.x, box.upper.x);
+  std::uniform_real_distribution<float> y(box.lower.y, box.upper.y);
+  std::uniform_real_distribution<float> z(box.lower.z, box.upper.z);
+  for (size_t i = 0; i < count; i++)
+    p.pos.push_back(vec3f(x(rng), y(rng), z(rng)));
+  while (p.rayOrg.size() < numRays) {
+    const vec3f org(x(rng), y(rng), z(rng));
+    p.addRay(box, org, randomDir(rng));
+  }
+  // from their origin on only, as secondary rays would be cast
+  for (vec2f &range : p.rayRange)
+    range.x = std::max(range.x, 0.f);
+  return p;
+}
+
+/*! points whose interpolation cell straddles a border between trees, and
+    rays running along those borders */
+static Pattern boundaryPattern(const box3f &box, const vec3i &gridSize,
+                               int blockWidth, size_t count, size_t numRays,
+                               int seed)
+{
+  Pattern p;
+  p.name = "boundary";
+  std::vector<int> axes;
+  for (int a = 0; a < 3; a++)
+    if (gridSize[a] > 1)
+      axes.push_back(a);
+  if (axes.empty())
+    throw std::runtime_error("the boundary pattern needs at least two trees");
+  std::mt19937 rng(seed + 1);
+  std::uniform_real_distribution<float> unit(0.f, 1.f);
+  auto borderPoint = [&](int &axis, float offset) {
+    axis = axes[rng() % axes.size()];
+    const int border = 1 + rng() % (gridSize[axis] - 1);
+    vec3f pos = box.lower + vec3f(unit(rng), unit(rng), unit(rng)) * box.size();
+    pos[axis] = border * blockWidth - 1 + offset;
+    return pos;
+  };
+  int axis;
+  for (size_t i = 0; i < count; i++)
+    p.pos.push_back(borderPoint(axis, unit(rng)));
+  while (p.rayOrg.size() < numRays) {
+    const vec3f org = borderPoint(axis, 0.5f);
+    vec3f dir = randomDir(rng);
+    dir[axis] = 0.f;
+    if (dot(dir, dir) > 1e-6f)
+      p.addRay(box, org, normalize(dir));
+  }
+  return p;
+}
+
+/*! the bricks (value brick plus brick info, and index brick) the lookups
+    of one sample descend through, summed per sample and as the working
+    set of a whole pattern */
+template<int N>
+struct BrickTouches
+{
+  typedef BrickTree<N, float> Tree;
+
+  explicit BrickTouches(const BrickTreeForest<N, float> &forest)
+    : forest(forest)
+  {}
+
+  void descend(const vec3i &voxel)
+  {
+    const vec3i c = max(vec3i(0), min(forest.originalVolumeSize - 1, voxel));
+    const int treeID = forest.treeID(c);
+    const Tree &t = forest.tree[treeID];
+    const BrickLevelTable &levels = forest.levels;
+    int32_t brickID = 0;
+    for (int level = 0; ; level++) {
+      sampleBricks.push_back(key(treeID, 0, brickID));
+      const int32_t ibID = t.brickInfo[brickID].indexBrickID;
+      if (ibID == Tree::invalidID() || levels.shift[level] <= levels.log2N)
+        break;
+      sampleBricks.push_back(key(treeID, 1, ibID));
+      const vec3i cell = levels.cellPos(c, level);
+      const int32_t childID = t.indexBrick[ibID].childID[cell.z][cell.y][cell.x];
+      if (childID == Tree::invalidID() || !t.isLoaded(childID))
+        break;
+      brickID = childID;
+    }
+  }
+
+  /*! the 8 corners sample() interpolates */
+  void descendCorners(const vec3f &pos)
+  {
+    const vec3i lo(pos);
+    for (int i = 0; i < 8; i++)
+      descend(lo + vec3i(i & 1, (i >> 1) & 1, (i >> 2) & 1));
+  }
+
+  void endSample()
+  {
+    std::sort(sampleBricks.begin(), sampleBricks.end());
+    sampleBricks.erase(std::unique(sampleBricks.begin(), sampleBricks.end()),
+                       sampleBricks.end());
+    for (uint64_t k : sampleBricks) {
+      touchedBytes += bytes(k);
+      if (workingSet.insert(k).second)
+        workingSetBytes += bytes(k);
+    }
+    sampleBricks.clear();
+    numSamples++;
+  }
+
+  double bytesPerSample() const
+  { return numSamples ? double(touchedBytes) / numSamples : 0.0; }
+
+  static uint64_t key(int treeID, int isIndex, int32_t brickID)
+  { return (uint64_t(treeID) << 33) | (uint64_t(isIndex) << 32) | uint32_t(brickID); }
+
+  static size_t bytes(uint64_t key)
+  {
+    return ((key >> 32) & 1)
+      ? sizeof(typename Tree::IndexBrick)
+      : sizeof(typename Tree::ValueBrick) + sizeof(typename Tree::BrickInfo);
+  }
+
+  const BrickTreeForest<N, float> &forest;
+  std::vector<uint64_t> sampleBricks;
+  std::unordered_set<uint64_t> workingSet;
+  size_t touchedBytes    = 0;
+  size_t workingSetBytes = 0;
+  size_t numSamples      = 0;
+};
+
+/*! time 'run' (which processes 'items' items) after a warmup run; best
+    and median of 'repeat' runs, in ns per item */
+template<typename F>
+static void timeKernel(int repeat, size_t items, F &&run,
+                       double &nsMin, double &nsMedian)
+{
+  run();
+  std::vector<double> ns;
+  for (int r = 0; r < repeat; r++) {
+    const ospray::time_point t0 = ospray::Time();
+    run();
+    ns.push_back(ospray::Time(t0) * 1e9 / std::max<size_t>(items, 1));
+  }
+  std::sort(ns.begin(), ns.end());
+  nsMin    = ns.front();
+  nsMedian = ns[ns.size() / 2];
+}
+
+// keeps the results of the timed kernels alive
+static volatile float benchSink;
+
+template<int N>
+static void benchForest(const std::string &fileName, size_t numBricks,
+                        const vec2f &valueRange,
+                        const vec3i &gridSize, size_t count, size_t numRays,
+                        float step, int repeat, int seed,
+                        std::vector<BenchResult> &results)
+{
+  // the camera only sets the level of detail; a narrow field of view
+  // keeps every sample at full resolution
+  OSPCamera camera = ospNewCamera("perspective");
+  ospSet3f(camera, "pos", 0.f, 0.f, 0.f);
+  ospSet3f(camera, "dir", 1.f, 1.f, 1.f);
+  ospSet3f(camera, "up", 0.f, 1.f, 0.f);
+  ospSet1f(camera, "fovy", 0.01f);
+  ospCommit(camera);
+  // opaque everywhere, so no tree or brick is skipped as empty
+  const float colors[]    = {1.f, 1.f, 1.f, 1.f, 1.f, 1.f};
+  const float opacities[] = {0.5f, 0.5f};
+  OSPData cData = ospNewData(2, OSP_FLOAT3, colors);
+  ospCommit(cData);
+  OSPData oData = ospNewData(2, OSP_FLOAT, opacities);
+  ospCommit(oData);
+  OSPTransferFunction tfn = ospNewTransferFunction("piecewise_linear");
+  ospSetData(tfn, "colors", cData);
+  ospSetData(tfn, "opacities", oData);
+  ospSetVec2f(tfn, "valueRange", (const osp::vec2f &)valueRange);
+  ospCommit(tfn);
+
+  ospray::BrickTree info;
+  info.setFromXML(fileName);
+  info.residencyFile = FileName(fileName).dropExt().str() + ".residency";
+  float renderThreshold = 0.f;
+  info.createBtVolume(camera, tfn, renderThreshold, vec2i(1024, 768));
+  BrickTreeVolume *volume = (BrickTreeVolume *)info.ospVolume;
+  ScalarVolumeSampler *sampler = volume->sampler;
+  BrickTreeForest<N, float> &forest =
+    *static_cast<BrickTreeForestSampler<float, N> *>(sampler)->forest;
+  // the snapshot preload has to have made every brick written resident
+  const size_t numLoaded = forest.brickCounts().loaded;
+  if (numLoaded != numBricks)
+    throw std::runtime_error("forest is not fully resident: "
+                             + std::to_string(numLoaded) + " of "
+                             + std::to_string(numBricks) + " bricks loaded");
+  // idle loaders still sweep the trees; nothing is left for them, and
+  // they must not compete with the timed kernels
+  forest.stopLoading();
+
+  const box3f box(vec3f(0.f), vec3f(forest.originalVolumeSize - 1));
+  std::vector<Pattern> patterns;
+  patterns.push_back(coherentPattern(box, count, numRays));
+  patterns.push_back(randomPattern(box, count, numRays, seed));
+  patterns.push_back(boundaryPattern(box, gridSize, 1 << forest.levels.blockShift,
+                                     count, numRays, seed));
+
+  for (const Pattern &p : patterns) {
+    const size_t n = p.pos.size();
+    std::vector<float> values(n);
+    std::vector<vec3f> gradients(n);
+    auto add = [&](const std::string &kernel, const std::string &unit,
+                   size_t items, double nsMin, double nsMedian,
+                   const BrickTouches<N> &touches) {
+      results.push_back({kernel, p.name, unit, items, nsMin, nsMedian,
+                         touches.bytesPerSample(), touches.workingSetBytes});
+      const BenchResult &r = results.back();
+      printf("#osp:micro: N=%i depth=%i %-14s %-8s %8.1f ns/%s (median %.1f)"
+             " %8.0f B/%s, working set %.2f MB\n",
+             N, forest.levels.depth, r.kernel.c_str(), r.pattern.c_str(),
+             r.nsMin, r.unit.c_str(), r.nsMedian, r.bytesPerItem,
+             r.unit.c_str(), r.workingSetBytes / double(1 << 20));
+    };
+    double nsMin, nsMedian;
+
+    // one descent per position
+    {
+      BrickTouches<N> touches(forest);
+      for (const vec3f &pos : p.pos) {
+        touches.descend(vec3i(pos));
+        touches.endSample();
+      }
+      timeKernel(repeat, n, [&]() {
+        float sum = 0.f;
+        for (const vec3f &pos : p.pos) {
+          const vec3i voxel(pos);
+          const int treeID = forest.treeID(voxel);
+          sum += forest.tree[treeID].findValue(treeID, voxel, forest.levels);
+        }
+        benchSink = sum;
+      }, nsMin, nsMedian);
+      add("findValue", "sample", n, nsMin, nsMedian, touches);
+    }
+
+    // trilinear samples, through the c++ sampler and through ispc
+    {
+      BrickTouches<N> touches(forest);
+      for (const vec3f &pos : p.pos) {
+        touches.descendCorners(pos);
+        touches.endSample();
+      }
+      timeKernel(repeat, n, [&]() {
+        float sum = 0.f;
+        for (const vec3f &pos : p.pos)
+          sum += sampler->sample(pos);
+        benchSink = sum;
+      }, nsMin, nsMedian);
+      add("forestSample", "sample", n, nsMin, nsMedian, touches);
+
+      timeKernel(repeat, n, [&]() {
+        volume->benchSample(p.pos.data(), values.data(), n);
+        benchSink = values[n / 2];
+      }, nsMin, nsMedian);
+      add("ispcSample", "sample", n, nsMin, nsMedian, touches);
+
+      // the renderer's wavefront path: the same samples sorted by tree
+      // and brick before the ispc sampler runs over them per bin. the
+      // sort keys are computed on all threads, the sampling on one
+      timeKernel(repeat, n, [&]() {
+        float *streamed = nullptr;
+        volume->computeSamples(&streamed, p.pos.data(), n);
+        benchSink = streamed[n / 2];
+        free(streamed);
+      }, nsMin, nsMedian);
+      add("streamSample", "sample", n, nsMin, nsMedian, touches);
+    }
+
+    // forward differences: the sample and its +x/+y/+z neighbors
+    {
+      BrickTouches<N> touches(forest);
+      for (const vec3f &pos : p.pos) {
+        touches.descendCorners(pos);
+        touches.descendCorners(pos + vec3f(1.f, 0.f, 0.f));
+        touches.descendCorners(pos + vec3f(0.f, 1.f, 0.f));
+        touches.descendCorners(pos + vec3f(0.f, 0.f, 1.f));
+        touches.endSample();
+      }
+      timeKernel(repeat, n, [&]() {
+        volume->benchGradient(p.pos.data(), gradients.data(), n);
+        benchSink = gradients[n / 2].x;
+      }, nsMin, nsMedian);
+      add("ispcGradient", "sample", n, nsMin, nsMedian, touches);
+    }
+
+    // ray steps; nothing is transparent, so the steps are evenly
+    // spaced and each descends once at the point it stops at
+    {
+      BrickTouches<N> touches(forest);
+      size_t numSteps = 0;
+      for (size_t r = 0; r < p.rayOrg.size(); r++) {
+        float t = p.rayRange[r].x;
+        do {
+          t += step;
+          touches.descend(vec3i(p.rayOrg[r] + t * p.rayDir[r]));
+          touches.endSample();
+          numSteps++;
+        } while (t <= p.rayRange[r].y);
+      }
+      timeKernel(repeat, numSteps, [&]() {
+        numSteps = volume->benchStepRays(p.rayOrg.data(), p.rayDir.data(),
+                                         p.rayRange.data(), p.rayOrg.size(),
+                                         step);
+      }, nsMin, nsMedian);
+      add("ispcStepRay", "step", numSteps, nsMin, nsMedian, touches);
+    }
+  }
+
+  // frees the forest, so the next config starts from an idle machine
+  ospRelease(info.ospVolume);
+  ospRelease(tfn);
+  ospRelease(cData);
+  ospRelease(oData);
+  ospRelease(camera);
+}
+
+static void writeJSON(const std::string &fileName,
+                      const std::vector<BenchConfig> &configs,
+                      const std::vector<size_t> &numBricks,
+                      const std::vector<std::vector<BenchResult>> &results,
+                      const vec3i &gridSize, size_t count, size_t numRays,
+                      float step, int repeat, int seed)
+{
+  FILE *out = fopen(fileName.c_str(), "w");
+  if (!out)
+    throw std::runtime_error("could not write " + fileName);
+  fprintf(out, "{\n");
+  fprintf(out, "  \"benchmark\": \"ospBrickMicroBench\",\n");
+  fprintf(out, "  \"gridSize\": [%i, %i, %i],\n", gridSize.x, gridSize.y, gridSize.z);
+  fprintf(out, "  \"count\": %zu,\n", count);
+  fprintf(out, "  \"rays\": %zu,\n", numRays);
+  fprintf(out, "  \"step\": %g,\n", step);
+  fprintf(out, "  \"repeat\": %i,\n", repeat);
+  fprintf(out, "  \"seed\": %i,\n", seed);
+  fprintf(out, "  \"configs\": [\n");
+  for (size_t c = 0; c < configs.size(); c++) {
+    fprintf(out, "    {\n");
+    fprintf(out, "      \"brickSize\": %i,\n", configs[c].N);
+    fprintf(out, "      \"depth\": %i,\n", configs[c].depth);
+    fprintf(out, "      \"numBricks\": %zu,\n", numBricks[c]);
+    fprintf(out, "      \"results\": [\n");
+    for (size_t i = 0; i < results[c].size(); i++) {
+      const BenchResult &r = results[c][i];
+      fprintf(out, "        {\"kernel\": \"%s\", \"pattern\": \"%s\", "
+                   "\"unit\": \"%s\", \"items\": %zu, \"nsMin\": %.3f, "
+                   "\"nsMedian\": %.3f, \"bytesPerItem\": %.1f, "
+                   "\"workingSetBytes\": %zu}%s\n",
+              r.kernel.c_str(), r.pattern.c_str(), r.unit.c_str(), r.items,
+              r.nsMin, r.nsMedian, r.bytesPerItem, r.workingSetBytes,
+              i + 1 < results[c].size() ? "," : "");
+    }
+    fprintf(out, "      ]\n");
+    fprintf(out, "    }%s\n", c + 1 < configs.size() ? "," : "");
+  }
+  fprintf(out, "  ]\n");
+  fprintf(out, "}\n");
+  fclose(out);
+}
+
+int main(int ac, const char **av)
+{
+  if (ospInit(&ac, av) != OSP_NO_ERROR)
+    throw std::runtime_error("could not initialize ospray");
+
+  std::vector<BenchConfig> configs;
+  vec3i gridSize(2);
+  size_t count = 1 << 18, numRays = 4096;
+  float step = 1.f;
+  int repeat = 5, seed = 1;
+  std::string dir, jsonFileName;
+  for (int i = 1; i < ac; i++) {
+    const std::string arg = av[i];
+    if (arg == "-config" && i + 2 < ac) {
+      const int N     = atoi(av[++i]);
+      const int depth = atoi(av[++i]);
+      configs.push_back({N, depth});
+    } else if (arg == "-grid" && i + 3 < ac) {
+      gridSize.x = atoi(av[++i]);
+      gridSize.y = atoi(av[++i]);
+      gridSize.z = atoi(av[++i]);
+    } else if (arg == "-count" && i + 1 < ac)
+      count = atol(av[++i]);
+    else if (arg == "-rays" && i + 1 < ac)
+      numRays = atol(av[++i]);
+    else if (arg == "-step" && i + 1 < ac)
+      step = atof(av[++i]);
+    else if (arg == "-repeat" && i + 1 < ac)
+      repeat = atoi(av[++i]);
+    else if (arg == "-seed" && i + 1 < ac)
+      seed = atoi(av[++i]);
+    else if (arg == "-dir" && i + 1 < ac)
+      dir = av[++i];
+    else if (arg == "-json" && i + 1 < ac)
+      jsonFileName = av[++i];
+    else if (arg == "-h" || arg == "--help")
+      usage();
+    else
+      usage("unknown arg '" + arg + "'");
+  }
+  // all three span 64 voxels per tree
+  if (configs.empty())
+    configs = {{2, 6}, {4, 3}, {8, 2}};
+  if (reduce_min(gridSize) < 1 || count < 1 || numRays < 1 || step <= 0.f
+      || repeat < 1)
+    usage("invalid benchmark size");
+  for (const BenchConfig &c : configs)
+    if (c.N != 2 && c.N != 4 && c.N != 8)
+      usage("unsupported brick size " + std::to_string(c.N));
+
+  bool removeDir = false;
+  if (dir.empty()) {
+    char tmpl[] = "/tmp/bt-micro-XXXXXX";
+    if (!mkdtemp(tmpl))
+      throw std::runtime_error("could not create a temporary directory");
+    dir = tmpl;
+    removeDir = true;
+  }
+
+  if (ospLoadModule("bricktree") != OSP_NO_ERROR)
+    throw std::runtime_error("failed to initialize BrickTree module");
+
+  std::vector<std::string> files;
+  std::vector<size_t> numBricks(configs.size());
+  std::vector<std::vector<BenchResult>> results(configs.size());
+  for (size_t c = 0; c < configs.size(); c++) {
+    const BenchConfig &cfg = configs[c];
+    const std::string base = dir + "/micro-n" + std::to_string(cfg.N) + "-d"
+                             + std::to_string(cfg.depth);
+    const ospray::time_point t0 = ospray::Time();
+    vec2f range;
+    switch (cfg.N) {
+    case 2:
+      range = writeForest<2>(base, cfg.depth, gridSize, numBricks[c], files);
+      break;
+    case 4:
+      range = writeForest<4>(base, cfg.depth, gridSize, numBricks[c], files);
+      break;
+    default:
+      range = writeForest<8>(base, cfg.depth, gridSize, numBricks[c], files);
+    }
+    std::cout << "#osp:micro: built forest of " << numBricks[c]
+              << " bricks (N=" << cfg.N << ", depth=" << cfg.depth << ") in "
+              << ospray::Time(t0) << " s" << std::endl;
+
+    const std::string fileName = base + ".osp";
+    switch (cfg.N) {
+    case 2:
+      benchForest<2>(fileName, numBricks[c], range, gridSize, count, numRays,
+                     step, repeat, seed, results[c]);
+      break;
+    case 4:
+      benchForest<4>(fileName, numBricks[c], range, gridSize, count, numRays,
+                     step, repeat, seed, results[c]);
+      break;
+    default:
+      benchForest<8>(fileName, numBricks[c], range, gridSize, count, numRays,
+                     step, repeat, seed, results[c]);
+    }
+  }
+
+  if (!jsonFileName.empty()) {
+    writeJSON(jsonFileName, configs, numBricks, results, gridSize, count,
+              numRays, step, repeat, seed);
+    std::cout << "#osp:micro: wrote " << jsonFileName << std::endl;
+  }
+
+  if (removeDir) {
+    for (const std::string &f : files)
+      unlink(f.c_str());
+    rmdir(dir.c_str());
+  }
+  return 0;
+}
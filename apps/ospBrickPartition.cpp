@@ -0,0 +1,105 @@
+// ======================================================================== //
+// Copyright SCI Institute, University of Utah, 2018
+// ======================================================================== //
+
+// splits the trees of a forest between MPI ranks, balanced by the bytes
+// of their bricks as listed in the forest's manifest, and writes the
+// assignment to a partition file for ospBrickBench -mpi -partition
+
+#include "ospBrickTreeTools.h"
+
+#include <iomanip>
+#include <iostream>
+
+using namespace ospcommon;
+
+static void usage(const std::string &msg = "")
+{
+  if (msg != "")
+    std::cout << "Error: " << msg << std::endl << std::endl;
+  std::cout << "Usage" << std::endl;
+  std::cout << "  ./ospBrickPartition <forest.osp> <args>" << std::endl;
+  std::cout << "with args:" << std::endl;
+  std::cout << " -ranks <n>         : number of ranks to split the trees between"
+            << std::endl;
+  std::cout << " -o <file>          : partition file to write "
+               "(default: <forest>.<n>.partition)" << std::endl;
+  exit(msg != "");
+}
+
+int main(int ac, const char **av)
+{
+  std::string inFileName, outFileName;
+  int numRanks = 0;
+  for (int i = 1; i < ac; i++) {
+    const std::string arg = av[i];
+    if (arg == "-ranks" && i + 1 < ac)
+      numRanks = atoi(av[++i]);
+    else if (arg == "-o" && i + 1 < ac)
+      outFileName = av[++i];
+    else if (arg == "-h" || arg == "--help")
+      usage();
+    else if (arg[0] != '-')
+      inFileName = arg;
+    else
+      usage("unknown arg '" + arg + "'");
+  }
+  if (inFileName.empty())
+    usage("no forest specified");
+  if (numRanks < 1)
+    usage("no number of ranks (-ranks) specified");
+
+  ospray::BrickTree forest;
+  forest.setFromXML(inFileName);
+  const FileName brickFileBase = FileName(forest.fileName).dropExt();
+  if (outFileName.empty())
+    outFileName = brickFileBase.str() + "." + std::to_string(numRanks)
+                  + ".partition";
+
+  const int numTrees = forest.gridSize.product();
+  const int voxelBytes = sizeof(float);
+  std::vector<ospray::bt::BrickTreeManifestEntry> entries;
+  if (!ospray::bt::readManifestFile(
+        ospray::bt::manifestFileName(brickFileBase),
+        ospray::bt::BrickTreeManifestHeader::make(numTrees, forest.brickSize,
+                                                  voxelBytes),
+        entries))
+    throw std::runtime_error("no valid manifest for " + inFileName
+                             + "; render the forest once to create it");
+
+  std::vector<double> bytes(numTrees), bricks(numTrees), trees(numTrees, 1.);
+  for (int i = 0; i < numTrees; i++) {
+    bytes[i]  = ospray::bt::manifestTreeBytes(entries[i], forest.brickSize,
+                                              voxelBytes);
+    bricks[i] = entries[i].numValueBricks;
+  }
+
+  const ospray::bt::TreePartition partition =
+    ospray::bt::TreePartition::kdSplit(forest.gridSize, numRanks, bytes);
+  partition.save(outFileName);
+
+  // predicted per-rank load
+  const std::vector<double> rankBytes  = partition.rankCost(bytes);
+  const std::vector<double> rankBricks = partition.rankCost(bricks);
+  const std::vector<double> rankTrees  = partition.rankCost(trees);
+  std::cout << "#osp:partition: " << numTrees << " trees over " << numRanks
+            << " ranks" << std::endl;
+  for (int r = 0; r < numRanks; r++) {
+    const box3i &b = partition.rankBox[r];
+    std::cout << "  rank " << std::setw(4) << r
+              << "  trees [" << b.lower << ".." << b.upper << ")"
+              << "  " << size_t(rankTrees[r]) << " trees, "
+              << size_t(rankBricks[r]) << " value bricks, "
+              << std::fixed << std::setprecision(1)
+              << rankBytes[r] / (1 << 20) << " MB" << std::endl;
+  }
+  const ospray::bt::TreePartition uniform =
+    ospray::bt::TreePartition::kdSplit(forest.gridSize, numRanks);
+  std::cout << std::setprecision(3)
+            << "#osp:partition: predicted imbalance (max/mean bytes) "
+            << partition.imbalance(bytes) << ", by value bricks "
+            << partition.imbalance(bricks) << "; equal tree counts would give "
+            << uniform.imbalance(bytes) << std::endl;
+  std::cout << "#osp:partition: wrote " << outFileName << std::endl;
+  return 0;
+}
@@ -0,0 +1,283 @@
+// ======================================================================== //
+// Copyright SCI Institute, University of Utah, 2018
+// ======================================================================== //
+
+// keeps a forest's bricks in a shared memory segment for as long as it
+// runs, so renderers started on this node (-brick-server <socket>) find
+// them resident instead of reading them from disk again. renderers map
+// the segment and sample it directly; the unix socket only carries their
+// requests, see bt/BrickServer.h
+
+#include "ospBrickTreeTools.h"
+#include "../bt/BrickServer.h"
+
+#include <csignal>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+using namespace ospcommon;
+using namespace ospray::bt;
+
+static volatile sig_atomic_t stopServer = 0;
+
+static void usage(const std::string &msg = "")
+{
+  if (msg != "")
+    std::cout << "Error: " << msg << std::endl << std::endl;
+  std::cout << "Usage" << std::endl;
+  std::cout << "  ./ospBrickServer <forest.osp> <args>" << std::endl;
+  std::cout << "with args:" << std::endl;
+  std::cout << " -socket <path>     : control socket "
+               "(default: /tmp/bt-<forest>.sock)" << std::endl;
+  std::cout << " -shm <name>        : shared memory segment of the bricks "
+               "(default: /bt-<forest>)" << std::endl;
+  std::cout << " -numa <policy>     : none, interleave or partition"
+            << std::endl;
+  std::cout << " -brick-url <url>   : read the trees' files from this http url"
+            << std::endl;
+  std::cout << " -brick-cache <dir> : local cache of what was read from the url"
+            << std::endl;
+  exit(msg != "");
+}
+
+/*! the bricks every client currently wants in the background; a
+    client's requests replace its earlier ones, the loaders work on the
+    union of all clients, coarse levels first */
+template<int N>
+struct BrickServer
+{
+  BrickServer(BrickTreeForest<N, float> &forest, const std::string &sharedName)
+    : forest(forest), sharedName(sharedName)
+  {}
+
+  /*! registered before its thread starts, so disconnectAll() cannot
+      miss it */
+  void addClient(int fd)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    clientFds.insert(fd);
+  }
+
+  void serveClient(int fd)
+  {
+    BrickServerMessage msg;
+    while (recvAll(fd, &msg, sizeof(msg))) {
+      if (msg.magic != BrickServerMessage::MAGIC)
+        break;
+      bool ok = true;
+      switch (msg.op) {
+      case BRICK_SERVER_HELLO: {
+        BrickServerHello hello;
+        memset(&hello, 0, sizeof(hello));
+        strncpy(hello.sharedName, sharedName.c_str(),
+                sizeof(hello.sharedName) - 1);
+        hello.numTrees  = forest.tree.size();
+        hello.brickSize = N;
+        ok = sendAll(fd, &hello, sizeof(hello));
+        break;
+      }
+      case BRICK_SERVER_REQUEST: {
+        std::vector<BrickServerRequest> requests(msg.count);
+        ok = recvAll(fd, requests.data(), msg.count * sizeof(requests[0]));
+        if (ok)
+          request(fd, requests);
+        break;
+      }
+      case BRICK_SERVER_CANCEL:
+        setBackground(fd, std::vector<PrefetchBrick>());
+        break;
+      case BRICK_SERVER_STATUS: {
+        BrickServerStatus status;
+        status.generation    = forest.residencyGeneration;
+        status.pendingBricks = forest.numPendingBricks();
+        ok = sendAll(fd, &status, sizeof(status));
+        break;
+      }
+      default:
+        ok = false;
+      }
+      if (!ok)
+        break;
+    }
+    // a client that went away no longer needs its bricks
+    setBackground(fd, std::vector<PrefetchBrick>());
+    std::lock_guard<std::mutex> lock(mtx);
+    clientFds.erase(fd);
+    close(fd);
+  }
+
+  /*! wake every client thread from its blocking read, so it returns */
+  void disconnectAll()
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    for (int fd : clientFds)
+      shutdown(fd, SHUT_RDWR);
+  }
+
+  void request(int fd, const std::vector<BrickServerRequest> &requests)
+  {
+    std::vector<PrefetchBrick> background;
+    for (const BrickServerRequest &r : requests) {
+      if (r.treeID < 0 || size_t(r.treeID) >= forest.tree.size()
+          || r.brickID < 0)
+        continue;
+      if (r.priority <= 0)
+        forest.requestBrick(r.treeID, r.brickID);
+      else
+        background.push_back({r.treeID, r.brickID, r.priority - 1});
+    }
+    setBackground(fd, std::move(background));
+  }
+
+  void setBackground(int fd, std::vector<PrefetchBrick> bricks)
+  {
+    std::lock_guard<std::mutex> lock(mtx);
+    if (bricks.empty())
+      clientBricks.erase(fd);
+    else
+      clientBricks[fd].swap(bricks);
+    std::vector<PrefetchBrick> merged;
+    for (auto &client : clientBricks)
+      merged.insert(merged.end(), client.second.begin(), client.second.end());
+    forest.setPrefetchQueue(std::move(merged));
+  }
+
+  BrickTreeForest<N, float> &forest;
+  const std::string sharedName;
+  std::mutex mtx;
+  std::map<int, std::vector<PrefetchBrick>> clientBricks;
+  //! connections still served; closed by their own thread
+  std::set<int> clientFds;
+};
+
+template<int N>
+static void serve(const ospray::BrickTree &info, const FileName &brickFileBase,
+                  const BrickArena::Placement &placement,
+                  std::shared_ptr<BrickSource> source,
+                  const std::string &socketPath)
+{
+  const int depth = BrickLevelTable(N, info.blockWidth).depth;
+  auto forest = std::make_shared<BrickTreeForest<N, float>>(
+    info.gridSize, info.validSize, depth, brickFileBase, placement,
+    std::vector<uint8_t>(), source);
+  if (!forest->arena.isOwner())
+    throw std::runtime_error("shared memory " + placement.sharedName
+                             + " is already served by another process");
+  BrickServer<N> server(*forest, placement.sharedName);
+
+  const int listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+  sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (socketPath.size() >= sizeof(addr.sun_path))
+    throw std::runtime_error("socket path too long: " + socketPath);
+  strcpy(addr.sun_path, socketPath.c_str());
+  unlink(socketPath.c_str());
+  if (listenFd < 0 || bind(listenFd, (sockaddr *)&addr, sizeof(addr)) != 0
+      || listen(listenFd, 16) != 0)
+    throw std::runtime_error("could not listen on " + socketPath);
+
+  std::cout << "#osp:server: serving " << forest->tree.size() << " trees ("
+            << forest->arena.size() / (1 << 20) << " MB) in "
+            << placement.sharedName << " on " << socketPath << std::endl;
+  std::vector<std::thread> clients;
+  while (!stopServer) {
+    pollfd p = {listenFd, POLLIN, 0};
+    if (poll(&p, 1, 200) <= 0)
+      continue;
+    const int fd = accept(listenFd, nullptr, nullptr);
+    if (fd >= 0) {
+      server.addClient(fd);
+      clients.emplace_back(&BrickServer<N>::serveClient, &server, fd);
+    }
+  }
+
+  // the client threads use the forest, so they go first; the forest's
+  // destructor then stops its loaders. clients still attached keep
+  // their mapping of the bricks
+  std::cout << "#osp:server: shutting down" << std::endl;
+  close(listenFd);
+  unlink(socketPath.c_str());
+  server.disconnectAll();
+  for (std::thread &t : clients)
+    t.join();
+  forest.reset();
+  BrickArena::removeShared(placement.sharedName);
+}
+
+int main(int ac, const char **av)
+{
+  std::string inFileName, socketPath, numa = "none", brickUrl, brickCache;
+  BrickArena::Placement placement;
+  for (int i = 1; i < ac; i++) {
+    const std::string arg = av[i];
+    if (arg == "-socket" && i + 1 < ac)
+      socketPath = av[++i];
+    else if (arg == "-shm" && i + 1 < ac)
+      placement.sharedName = av[++i];
+    else if (arg == "-numa" && i + 1 < ac)
+      numa = av[++i];
+    else if (arg == "-brick-url" && i + 1 < ac)
+      brickUrl = av[++i];
+    else if (arg == "-brick-cache" && i + 1 < ac)
+      brickCache = av[++i];
+    else if (arg == "-h" || arg == "--help")
+      usage();
+    else if (arg[0] != '-')
+      inFileName = arg;
+    else
+      usage("unknown arg '" + arg + "'");
+  }
+  if (inFileName.empty())
+    usage("no forest specified");
+  if (numa == "interleave")
+    placement.numa = BrickArena::NUMA_INTERLEAVE;
+  else if (numa == "partition")
+    placement.numa = BrickArena::NUMA_PARTITION;
+  else if (numa != "none")
+    usage("unknown numa policy '" + numa + "'");
+
+  // initializes the tasking system the loaders run on
+  if (ospInit(&ac, av) != OSP_NO_ERROR)
+    throw std::runtime_error("could not initialize ospray");
+
+  ospray::BrickTree info;
+  info.setFromXML(inFileName);
+  const FileName brickFileBase = FileName(info.fileName).dropExt();
+  if (placement.sharedName.empty())
+    placement.sharedName = "/bt-" + brickFileBase.base();
+  if (placement.sharedName[0] != '/')
+    placement.sharedName = "/" + placement.sharedName;
+  if (socketPath.empty())
+    socketPath = "/tmp/bt-" + brickFileBase.base() + ".sock";
+
+  std::shared_ptr<BrickSource> source =
+    BrickSource::open(brickFileBase.str(), brickUrl, brickCache);
+
+  signal(SIGINT, [](int) { stopServer = 1; });
+  signal(SIGTERM, [](int) { stopServer = 1; });
+
+  switch (info.brickSize) {
+  case 2:
+    serve<2>(info, brickFileBase, placement, source, socketPath);
+    break;
+  case 4:
+    serve<4>(info, brickFileBase, placement, source, socketPath);
+    break;
+  case 8:
+    serve<8>(info, brickFileBase, placement, source, socketPath);
+    break;
+  default:
+    throw std::runtime_error("unsupported brick size "
+                             + std::to_string(info.brickSize));
+  }
+  return 0;
+}
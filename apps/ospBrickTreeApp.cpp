@@ -14,6 +14,7 @@
 #include "common/helper.h"
 #include "ospCommandLine.h"
 #include "ospBrickTreeTools.h"
+#include "CameraPath.h"
 
 #if USE_VIEWER
 #include "opengl/viewer.h"
@@ -24,10 +25,182 @@
 #ifdef __unix__
 # include <unistd.h>
 #endif
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <string>
 #include <vector>
 
 using namespace ospcommon;
 
+// the volume and file whose residency snapshot is written at exit
+static ospray::bt::BrickTreeVolume *snapshotVolume = nullptr;
+static std::string snapshotFile;
+
+static void saveResidencySnapshot()
+{
+  // an exception escaping an exit handler would terminate the process
+  // while the loader threads are still running; a lost snapshot only
+  // costs the next run its warm start
+  try {
+    const size_t numBricks = snapshotVolume->saveResidency(snapshotFile);
+    std::cout << "#osp: saved " << numBricks << " resident bricks to "
+              << snapshotFile << std::endl;
+  } catch (const std::exception &e) {
+    std::cerr << "#osp: could not save the residency snapshot: "
+              << e.what() << std::endl;
+  }
+}
+
+static void setCamera(OSPCamera camera, const vec3f &vp, const vec3f &vi,
+                      const vec3f &vu)
+{
+  const vec3f vd = vi - vp;
+  ospSetVec3f(camera, "pos", (const osp::vec3f &)vp);
+  ospSetVec3f(camera, "dir", (const osp::vec3f &)vd);
+  ospSetVec3f(camera, "up", (const osp::vec3f &)vu);
+  ospCommit(camera);
+}
+
+#if !USE_VIEWER
+/*! nearest-rank percentile 'p' of sorted 'v', in milliseconds */
+static double percentileMs(const std::vector<double> &v, double p)
+{
+  if (v.empty())
+    return 0.;
+  // the smallest value with at least p percent of all values <= it
+  const double rank = std::ceil(p / 100. * v.size());
+  const size_t i = std::min(v.size(), size_t(std::max(rank, 1.))) - 1;
+  return 1000. * v[i];
+}
+
+/*! plays a camera path: the camera moves to every keyframe and holds
+    there until no new bricks arrive for 3 frames (at most the
+    keyframe's hold frames). every frame's render time and the bricks
+    requested / loaded and bytes read meanwhile go to <output>.csv, the
+    frame time percentiles and time to converge per keyframe to stdout */
+static void playCameraPath(const ospray::CameraPath &path,
+                           OSPCamera camera, OSPRenderer renderer,
+                           OSPFrameBuffer fb,
+                           const ospray::bt::BrickTreeVolume *btVolume,
+                           const std::string &csvFileName, bool report)
+{
+  std::ofstream csv;
+  if (report) {
+    csv.open(csvFileName);
+    if (!csv)
+      throw std::runtime_error("could not write " + csvFileName);
+    csv << "frame,keyframe,phase,seconds,bricksRequested,bricksLoaded,"
+        << "bytesRead,pendingBricks" << std::endl;
+  }
+
+  struct KeyframeStats
+  {
+    std::vector<double> frameTimes;
+    size_t bricksLoaded = 0;
+    size_t bytesRead    = 0;
+    double converged    = -1.;
+  };
+  std::vector<KeyframeStats> stats(path.keys.size());
+  size_t generation = btVolume ? btVolume->residencyGeneration() : 0;
+  ospray::bt::BrickCounts counts =
+    btVolume ? btVolume->brickCounts() : ospray::bt::BrickCounts();
+  int frame = 0;
+
+  // returns whether the frame had all its bricks
+  auto renderFrame = [&](size_t k, const char *phase) {
+    const ospray::time_point t0 = ospray::Time();
+    ospRenderFrame(fb, renderer, OSP_FB_COLOR | OSP_FB_ACCUM);
+    const double seconds = ospray::Time(t0);
+    bool stable = true;
+    size_t pending = 0;
+    ospray::bt::BrickCounts now;
+    if (btVolume) {
+      const size_t current = btVolume->residencyGeneration();
+      if (current != generation) {
+        generation = current;
+        ospFrameBufferClear(fb, OSP_FB_COLOR | OSP_FB_ACCUM);
+        stable = false;
+      }
+      pending = btVolume->numPendingBricks();
+      stable &= pending == 0;
+      now = btVolume->brickCounts();
+    }
+    KeyframeStats &s = stats[k];
+    s.frameTimes.push_back(seconds);
+    s.bricksLoaded += now.loaded - counts.loaded;
+    s.bytesRead    += now.bytesRead - counts.bytesRead;
+    if (report)
+      csv << frame << "," << k << "," << phase << "," << seconds << ","
+          << now.requested - counts.requested << ","
+          << now.loaded - counts.loaded << ","
+          << now.bytesRead - counts.bytesRead << "," << pending << std::endl;
+    counts = now;
+    frame++;
+    return stable;
+  };
+
+  for (size_t k = 0; k < path.keys.size(); k++) {
+    const ospray::CameraKeyframe &key = path.keys[k];
+    // the first keyframe is where the camera starts
+    for (int f = 1; k > 0 && f < key.frames; f++) {
+      const ospray::CameraKeyframe c = path.at(k, f / float(key.frames));
+      setCamera(camera, c.vp, c.vi, c.vu);
+      ospFrameBufferClear(fb, OSP_FB_COLOR | OSP_FB_ACCUM);
+      renderFrame(k, "move");
+    }
+    setCamera(camera, key.vp, key.vi, key.vu);
+    ospFrameBufferClear(fb, OSP_FB_COLOR | OSP_FB_ACCUM);
+    // converged once the first of 3 frames in a row had all bricks
+    const ospray::time_point arrived = ospray::Time();
+    double stableSince = 0.;
+    int stableFrames = 0;
+    for (int f = 0; f < std::max(key.hold, 1); f++) {
+      const bool stable = renderFrame(k, "hold");
+      if (!stable) {
+        stableFrames = 0;
+        continue;
+      }
+      if (stableFrames++ == 0)
+        stableSince = ospray::Time(arrived);
+      if (stableFrames >= 3) {
+        stats[k].converged = stableSince;
+        break;
+      }
+    }
+  }
+
+  if (!report)
+    return;
+  std::vector<double> all;
+  for (size_t k = 0; k < stats.size(); k++) {
+    KeyframeStats &s = stats[k];
+    all.insert(all.end(), s.frameTimes.begin(), s.frameTimes.end());
+    std::sort(s.frameTimes.begin(), s.frameTimes.end());
+    std::cout << "#osp:bench: keyframe " << k << ": "
+              << s.frameTimes.size() << " frames, p50 "
+              << percentileMs(s.frameTimes, 50) << " ms, p95 "
+              << percentileMs(s.frameTimes, 95) << " ms, p99 "
+              << percentileMs(s.frameTimes, 99) << " ms, "
+              << s.bricksLoaded << " bricks / " << s.bytesRead
+              << " bytes loaded, ";
+    if (s.converged >= 0.)
+      std::cout << "converged after " << s.converged << " s";
+    else
+      std::cout << "not converged";
+    std::cout << std::endl;
+  }
+  std::sort(all.begin(), all.end());
+  std::cout << "#osp:bench: camera path: " << all.size() << " frames, p50 "
+            << percentileMs(all, 50) << " ms, p95 " << percentileMs(all, 95)
+            << " ms, p99 " << percentileMs(all, 99) << " ms" << std::endl;
+  std::cout << "#osp:bench: per-frame timings written to " << csvFileName
+            << std::endl;
+}
+#endif
+
 int main(int ac, const char **av)
 {
   //-----------------------------------------------------
@@ -57,13 +230,28 @@ int main(int ac, const char **av)
   }
 
 #if USE_VIEWER
+  if (args.mpi)
+    throw std::runtime_error("-mpi is only supported by ospBrickBench");
+  if (!args.cameraPath.empty())
+    throw std::runtime_error("-camera-path is only supported by ospBrickBench");
   int window = viewer::Init(ac, av, args.imgSize.x, args.imgSize.y);
 #endif
 
   //-----------------------------------------------------
   // Create ospray context
   //-----------------------------------------------------
-  auto device = ospGetCurrentDevice();
+  OSPDevice device = nullptr;
+  if (args.mpi) {
+    // data parallel: every rank runs this program and renders the trees
+    // it owns, the distributed framebuffer composites the final image on
+    // rank 0
+    if (ospLoadModule("mpi") != OSP_NO_ERROR)
+      throw std::runtime_error("failed to load the MPI module");
+    device = ospNewDevice("mpi_distributed");
+    ospSetCurrentDevice(device);
+  } else {
+    device = ospGetCurrentDevice();
+  }
   if (device == nullptr) {
     throw std::runtime_error("FATAL ERROR DURING GETTING CURRENT DEVICE!");
     return 1;
@@ -77,17 +265,31 @@ int main(int ac, const char **av)
   if (ospLoadModule("bricktree") != OSP_NO_ERROR) {
     throw std::runtime_error("failed to initialize BrickTree module");
   }
+  const int rank     = args.mpi ? mpicommon::world.rank : 0;
+  const int numRanks = args.mpi ? mpicommon::world.size : 1;
+  if (args.mpi) {
+    std::cout << "#osp:bench: rank " << rank << " of " << numRanks
+              << std::endl;
+    // only the distributed raycaster composites per-rank regions
+    args.rendererName = "mpi_raycast";
+  }
 
 
     // setup camera
+  std::unique_ptr<ospray::CameraPath> cameraPath;
+  if (!args.cameraPath.empty()) {
+    cameraPath.reset(new ospray::CameraPath(args.cameraPath,
+                                            args.pathFrames.x,
+                                            args.pathFrames.y));
+    // the path starts at its first keyframe
+    args.vp = cameraPath->keys[0].vp;
+    args.vi = cameraPath->keys[0].vi;
+    args.vu = cameraPath->keys[0].vu;
+  }
   OSPCamera camera = ospNewCamera("perspective");
-  vec3f vd         = args.vi - args.vp;
-  ospSetVec3f(camera, "pos", (const osp::vec3f &)args.vp);
-  ospSetVec3f(camera, "dir", (const osp::vec3f &)vd);
-  ospSetVec3f(camera, "up", (const osp::vec3f &)args.vu);
   ospSet1f(camera, "aspect", args.imgSize.x / (float)args.imgSize.y);
   ospSet1f(camera, "fovy", 60.f);
-  ospCommit(camera);
+  setCamera(camera, args.vp, args.vi, args.vu);
 
   //-----------------------------------------------------
   // Create ospray objects
@@ -121,20 +323,52 @@ int main(int ac, const char **av)
   ospRelease(oData);
 
   // create volume
+  std::shared_ptr<ospray::BrickTree> bricktreeVolume;
+  ospray::bt::BrickTreeVolume *btVolume = nullptr;
   if (!args.use_hacked_vol) {
     std::cout << "\033[32;1m"
               << "#osp:bench using BrickTree volume"
               << "\033[0m" 
               << std::endl;
-    std::shared_ptr<ospray::BrickTree> bricktreeVolume =
-      std::make_shared<ospray::BrickTree>();
+    bricktreeVolume = std::make_shared<ospray::BrickTree>();
     bricktreeVolume->adaptiveSampling = args.use_adaptive_sampling;
+    bricktreeVolume->hugePages = args.hugePages;
+    bricktreeVolume->numaPolicy = args.numaPolicy;
+    bricktreeVolume->sharedMemory = args.sharedMemory;
+    bricktreeVolume->brickServer = args.brickServer;
+    bricktreeVolume->brickUrl = args.brickUrl;
+    bricktreeVolume->brickCache = args.brickCache;
+    // ranks would overwrite each other's snapshot
+    if (!args.residencyFile.empty() && args.mpi)
+      std::cout << "#osp: -residency is ignored with -mpi" << std::endl;
+    else
+      bricktreeVolume->residencyFile = args.residencyFile;
+    bricktreeVolume->rank = rank;
+    bricktreeVolume->numRanks = numRanks;
+    bricktreeVolume->partitionFile = args.partitionFile;
     bricktreeVolume->setFromXML(args.inputFiles[0]);
-    bricktreeVolume->createBtVolume(camera,transferFcn,args.renderThreshold);
+    bricktreeVolume->createBtVolume(camera,transferFcn,args.renderThreshold,
+                                    args.imgSize);
     ospAddVolume(world,bricktreeVolume->ospVolume);
-    ospray::bt::BrickTreeVolume *btVolume = 
-      (ospray::bt::BrickTreeVolume *)bricktreeVolume->ospVolume;  
-    box3f worldBounds(vec3f(0), vec3f(btVolume->validSize) - vec3f(1));
+    if (args.mpi) {
+      // tell the compositor which part of the volume this rank renders;
+      // the handle is not a pointer into this process with this device
+      const box3f region = bricktreeVolume->getRegion();
+      const bool ownsTrees = reduce_min(region.size()) > 0.f;
+      OSPData regions = ospNewData(ownsTrees ? 2 : 0, OSP_FLOAT3, &region);
+      ospCommit(regions);
+      ospSet1i(world, "id", rank);
+      ospSetData(world, "regions", regions);
+      ospRelease(regions);
+    } else {
+      btVolume = (ospray::bt::BrickTreeVolume *)bricktreeVolume->ospVolume;
+      // the viewer exits from its event loop, so save from an exit handler
+      if (!args.residencyFile.empty()) {
+        snapshotVolume = btVolume;
+        snapshotFile   = args.residencyFile;
+        std::atexit(saveResidencySnapshot);
+      }
+    }
   } else {
     std::cout << "\033[33;1m"
               << "#osp:bench using hacked volume"
@@ -233,6 +467,17 @@ int main(int ac, const char **av)
 
   viewer::Handler(transferFcn, args.valueRange.x, args.valueRange.y);
   viewer::Handler(world, renderer);
+  if (bricktreeVolume) {
+    viewer::Handler(bricktreeVolume->ospVolume, args.targetFPS);
+    viewer::Handler([btVolume]() { return btVolume->residencyGeneration(); },
+                    [btVolume]() { return btVolume->numPendingBricks(); });
+    viewer::Handler([btVolume](const osp::vec3f &pos, const osp::vec3f &dir,
+                               float fovy, float aspect) {
+                      btVolume->prefetch((const vec3f &)pos,
+                                         (const vec3f &)dir, fovy, aspect);
+                    },
+                    [btVolume]() { btVolume->cancelPrefetch(); });
+  }
   viewer::Render(window);
 
 #else
@@ -243,31 +488,62 @@ int main(int ac, const char **av)
       (const osp::vec2i &)args.imgSize, OSP_FB_SRGBA, OSP_FB_COLOR | OSP_FB_ACCUM);
   ospFrameBufferClear(fb, OSP_FB_COLOR | OSP_FB_ACCUM);
 
-  // render 10 more frames, which are accumulated to result in a better
-  // converged image
-  std::cout << "#osp:bench: warming-up for " << args.numFrames.x << " frames"
-            << std::endl;
-  for (int frames = 0; frames < args.numFrames.x;
-       frames++) {  // skip frames to warmup
-    ospRenderFrame(fb, renderer, OSP_FB_COLOR | OSP_FB_ACCUM);
-  }
-  std::cout << "#osp:bench: benchmarking for " << args.numFrames.y << " frames"
-            << std::endl;
-  auto t = ospray::Time();
-  for (int frames = 0; frames < args.numFrames.y; frames++) {
-    ospRenderFrame(fb, renderer, OSP_FB_COLOR | OSP_FB_ACCUM);
+  if (cameraPath) {
+    std::cout << "#osp:bench: playing camera path " << args.cameraPath
+              << " (" << cameraPath->keys.size() << " keyframes)"
+              << std::endl;
+    playCameraPath(*cameraPath, camera, renderer, fb, btVolume,
+                   args.outputImageName + ".csv", rank == 0);
+  } else {
+    // restart accumulation whenever new bricks became resident, so coarse
+    // fallback samples do not stay blended into the final image
+    size_t generation = btVolume ? btVolume->residencyGeneration() : 0;
+    auto renderProgressive = [&]() {
+      ospRenderFrame(fb, renderer, OSP_FB_COLOR | OSP_FB_ACCUM);
+      const size_t current = btVolume ? btVolume->residencyGeneration() : 0;
+      if (current != generation) {
+        generation = current;
+        ospFrameBufferClear(fb, OSP_FB_COLOR | OSP_FB_ACCUM);
+        return false;
+      }
+      return !btVolume || btVolume->numPendingBricks() == 0;
+    };
+
+    // render 10 more frames, which are accumulated to result in a better
+    // converged image; the warm-up stops early once no new bricks arrive
+    std::cout << "#osp:bench: warming-up for " << args.numFrames.x << " frames"
+              << std::endl;
+    auto tw = ospray::Time();
+    int stableFrames = 0;
+    for (int frames = 0; frames < args.numFrames.x;
+         frames++) {  // skip frames to warmup
+      stableFrames = renderProgressive() ? stableFrames + 1 : 0;
+      if (btVolume && stableFrames >= 3) {
+        std::cout << "#osp:bench: converged after " << frames + 1 
+                  << " frames (" << ospray::Time(tw) << " s)" << std::endl;
+        break;
+      }
+    }
+    std::cout << "#osp:bench: benchmarking for " << args.numFrames.y << " frames"
+              << std::endl;
+    auto t = ospray::Time();
+    for (int frames = 0; frames < args.numFrames.y; frames++) {
+      renderProgressive();
+    }
+    auto et = ospray::Time(t);
+    std::cout << "#osp:bench: average framerate " << args.numFrames.y / et
+              << std::endl;
   }
-  auto et = ospray::Time(t);
-  std::cout << "#osp:bench: average framerate " << args.numFrames.y / et
-            << std::endl;
 
-  // save frame
-  const uint32_t *buffer = (uint32_t *)ospMapFrameBuffer(fb, OSP_FB_COLOR);
-  ospray::writePPM(
-      args.outputImageName + ".ppm", args.imgSize.x, args.imgSize.y, buffer);
-  ospUnmapFrameBuffer(buffer, fb);
-  std::cout << "#osp:bench: save image to " << args.outputImageName + ".ppm"
-            << std::endl;
+  // save frame; with -mpi only rank 0 holds the composited image
+  if (rank == 0) {
+    const uint32_t *buffer = (uint32_t *)ospMapFrameBuffer(fb, OSP_FB_COLOR);
+    ospray::writePPM(
+        args.outputImageName + ".ppm", args.imgSize.x, args.imgSize.y, buffer);
+    ospUnmapFrameBuffer(buffer, fb);
+    std::cout << "#osp:bench: save image to " << args.outputImageName + ".ppm"
+              << std::endl;
+  }
 
 #endif
 
@@ -12,7 +12,11 @@ namespace ospray{
       format("<none>"),
       fileName("<none>"),
       valueRange(one),
-      adaptiveSampling{false}
+      adaptiveSampling{false},
+      hugePages{false},
+      numaPolicy("none"),
+      rank(0),
+      numRanks(1)
   {}; 
 
   BrickTree::~BrickTree(){
@@ -28,6 +32,15 @@ namespace ospray{
     return bounds;
   }
 
+  box3f BrickTree::getRegion() const
+  {
+    // has to match the split the volume makes when opening its forest
+    return bt::forestPartition(FileName(fileName).dropExt(), gridSize,
+                               brickSize, sizeof(float), numRanks,
+                               partitionFile)
+      .region(rank, blockWidth, validSize);
+  }
+
   void BrickTree::setFromXML(const std::string &fileName)
   {
     std::shared_ptr<xml::XMLDoc> doc = xml::readXML(fileName);
@@ -85,7 +98,8 @@ namespace ospray{
     this->voxelType = typeForString(format.c_str());
   }
 
-  void BrickTree::createBtVolume(OSPCamera& camera,OSPTransferFunction& tfn, float& renderThres)
+  void BrickTree::createBtVolume(OSPCamera& camera,OSPTransferFunction& tfn, float& renderThres,
+                                 const vec2i& imageSize)
   {
     if(ospVolume) { ospVolume = nullptr; }
     ospVolume = ospNewVolume("BrickTreeVolume");
@@ -104,6 +118,17 @@ namespace ospray{
     ospSetObject(ospVolume,"transferFunction",tfn);
     ospSetObject(ospVolume,"camera",camera);
     ospSet1f(ospVolume,"renderThreshold", renderThres);
+    ospSet2i(ospVolume,"imageSize", imageSize.x, imageSize.y);
+    ospSet1i(ospVolume,"hugePages", hugePages);
+    ospSetString(ospVolume,"numaPolicy", numaPolicy.c_str());
+    ospSetString(ospVolume,"sharedMemory", sharedMemory.c_str());
+    ospSetString(ospVolume,"brickServer", brickServer.c_str());
+    ospSetString(ospVolume,"brickUrl", brickUrl.c_str());
+    ospSetString(ospVolume,"brickCache", brickCache.c_str());
+    ospSetString(ospVolume,"residencyFile", residencyFile.c_str());
+    ospSet1i(ospVolume,"rank", rank);
+    ospSet1i(ospVolume,"numRanks", numRanks);
+    ospSetString(ospVolume,"partitionFile", partitionFile.c_str());
     ospCommit(ospVolume);
   }
 }
@@ -19,7 +19,8 @@ namespace ospray{
     box3f getBounds();
     void setFromXML(const std::string &fileName);
     void loadOSP(const ospcommon::xml::Node &node);
-    void createBtVolume(OSPCamera& camera,OSPTransferFunction& tfn, float& renderThres);
+    void createBtVolume(OSPCamera& camera,OSPTransferFunction& tfn, float& renderThres,
+                        const vec2i& imageSize);
 
       //! handle to the ospray volume object
     OSPVolume   ospVolume;
@@ -44,5 +45,27 @@ namespace ospray{
     range_t<float> valueRange;
     /*! whether to use adaptive sampling */
     bool adaptiveSampling;
+    /*! back the brick memory with 2MB pages */
+    bool hugePages;
+    /*! numa placement of the brick memory: none, interleave, partition */
+    std::string numaPolicy;
+    /*! shared memory segment to share the brick memory through */
+    std::string sharedMemory;
+    /*! socket of an ospBrickServer to take the bricks from */
+    std::string brickServer;
+    /*! http url the trees' files are read from, and their local cache */
+    std::string brickUrl;
+    std::string brickCache;
+    /*! residency snapshot to preload the bricks of a previous run from */
+    std::string residencyFile;
+    /*! data parallel rendering: this process' rank and the number of
+        ranks the trees are split between */
+    int rank;
+    int numRanks;
+    /*! tree-to-rank assignment written by ospBrickPartition, optional */
+    std::string partitionFile;
+
+    /*! the part of the volume this rank renders */
+    box3f getRegion() const;
   };
 };//::ospray
@@ -107,6 +107,18 @@ namespace ospray {
     bool use_hacked_vol{false};
     bool use_adaptive_sampling{false};
     float renderThreshold{0.0f};
+    float targetFPS{0.0f};
+    bool hugePages{false};
+    std::string numaPolicy{"none"};
+    bool mpi{false};
+    std::string partitionFile;
+    std::string sharedMemory;
+    std::string brickServer;
+    std::string brickUrl;
+    std::string brickCache;
+    std::string residencyFile;
+    std::string cameraPath;
+    vec2i pathFrames{60 /* move */, 300 /* hold at most */};
   };
 
   inline void CommandLine::Parse(int ac, const char **av)
@@ -154,6 +166,37 @@ namespace ospray {
         use_hacked_vol = true;
       } else if (str =="-rt"){
         ospray::Parse<1>(ac, av, i, renderThreshold);
+      } else if (str == "-target-fps") {
+        ospray::Parse<1>(ac, av, i, targetFPS);
+      } else if (str == "-huge-pages") {
+        hugePages = true;
+      } else if (str == "-numa") {
+        numaPolicy = av[++i];
+      } else if (str == "-mpi") {
+        mpi = true;
+      } else if (str == "-partition") {
+        partitionFile = av[++i];
+      } else if (str == "-shm") {
+        sharedMemory = av[++i];
+      } else if (str == "-brick-server") {
+        brickServer = av[++i];
+      } else if (str == "-brick-url") {
+        brickUrl = av[++i];
+      } else if (str == "-brick-cache") {
+        brickCache = av[++i];
+      } else if (str == "-residency") {
+        residencyFile = av[++i];
+      } else if (str == "-camera-path") {
+        cameraPath = av[++i];
+      } else if (str == "-path-frames") {
+        try {
+          ospray::Parse<2>(ac, av, i, pathFrames);
+        } catch (const std::runtime_error &e) {
+          throw std::runtime_error(std::string(e.what()) +
+              " usage: -path-frames "
+              "<# of frames between keyframes> "
+              "<max # of frames held at a keyframe>");
+        }
       }
       else if (str[0] == '-') {
         throw std::runtime_error("unknown argument: " + str);
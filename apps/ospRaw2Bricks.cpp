@@ -16,11 +16,16 @@
 
 // own
 #include "../bt/BrickTreeBuilder.h"
+#include "SyntheticField.h"
 #ifdef PARALLEL_MULTI_TREE_BUILD
 # include <tbb/task_scheduler_init.h>
 #endif
 // ospcommon
 #include "ospcommon/array3D/Array3D.h"
+// mpi
+#include <mpi.h>
+// std
+#include <type_traits>
 
 namespace ospray {
   namespace bt {
@@ -47,6 +52,14 @@ namespace ospray {
       cout << " --depth|-d <depth>     : num levels per block" << endl;
       cout << " -o <outfilename.osp>   : output file name" << endl;
       cout << " -t <threshold>         : threshold of which nodes to split or not (ABSOLUTE float val)" << endl;
+      cout << " --mpi                  : build all blocks at once, split between the MPI ranks (under mpirun)" << endl;
+      cout << " --partition <file>     : with --mpi: tree-to-rank assignment written by ospBrickPartition" << endl;
+      cout << " --synthetic <field>    : build a procedural volume of -dims instead of reading one;" << endl;
+      cout << "                          noise, marschner-lobb, blobs or turbulence" << endl;
+      cout << " --seed <s>             : with --synthetic: random seed (default 0)" << endl;
+      cout << " --frequency <f>        : with --synthetic: features across the volume (default 8)" << endl;
+      cout << " --emptiness <e>        : with --synthetic blobs: fraction of empty blob cells (default 0.9)" << endl;
+      cout << " --spectrum <s>         : with --synthetic turbulence: energy spectrum slope (default 5/3)" << endl;
       exit(msg != "");
     }
 
@@ -72,7 +85,10 @@ namespace ospray {
                              int level,
                              int blockWidth);
       
-      void save(const std::string &ospFileName, const vec3i &validSize);
+      /*! write the block's .osp and .ospbin files; returns what the
+          forest's manifest records about the block */
+      BrickTreeManifestEntry save(const std::string &ospFileName,
+                                  const vec3i &validSize);
 
       range_t<double> valueRange;
       double        averageValue;
@@ -202,6 +218,310 @@ namespace ospray {
       return range;
     }
 
+    /*! write the toplevel .osp file describing the whole forest */
+    template<int N, typename T>
+    void saveForest(const std::string &outFileName,
+                    const vec3i &rootGridSize,
+                    int blockWidth,
+                    const vec3i &inputSize)
+    {
+      const std::string ospFileName = outFileName+".osp";
+      FILE *osp = fopen(ospFileName.c_str(),"w");
+      if (!osp)
+        throw std::runtime_error("could not write "+ospFileName);
+      fprintf(osp,"<?xml?>\n");
+      fprintf(osp,"<ospray>\n");
+      {
+        fprintf(osp,"<MultiBrickTree\n");
+        fprintf(osp,"   gridSize=\"%i %i %i\"\n",rootGridSize.x,rootGridSize.y,rootGridSize.z);
+        fprintf(osp,"   format=\"%s\"\n",typeToString<T>());
+        fprintf(osp,"   brickSize=\"%i\"\n",N);
+        fprintf(osp,"   blockWidth=\"%i\"\n",blockWidth);
+        fprintf(osp,"   validSize=\"%i %i %i\"\n",inputSize.x,inputSize.y,inputSize.z);
+        fprintf(osp,"\t/>\n");
+      }
+      fprintf(osp,"</ospray>\n");
+      fclose(osp);
+    }
+
+    /*! read the voxels of 'box' (in file coordinates) of a raw file of
+        'dims' voxels of type 'In' into 'out'. collective: every rank
+        calls this exactly once, with its own (possibly empty) box */
+    template<typename In, typename T>
+    void readBoxCollective(const std::string &fileName,
+                           const vec3i &dims,
+                           const box3i &box,
+                           ActualArray3D<T> &out)
+    {
+      MPI_File file;
+      if (MPI_File_open(MPI_COMM_WORLD,(char *)fileName.c_str(),MPI_MODE_RDONLY,
+                        MPI_INFO_NULL,&file) != MPI_SUCCESS)
+        throw std::runtime_error("could not open RAW file "+fileName);
+      MPI_Datatype voxel;
+      MPI_Type_contiguous(sizeof(In),MPI_BYTE,&voxel);
+      MPI_Type_commit(&voxel);
+
+      // MPI counts are ints, so the box is read in slabs of z planes;
+      // ranks that are done keep joining the collective reads
+      const vec3i size = box.size();
+      const bool empty = reduce_min(size) <= 0;
+      const size_t planeVoxels = empty ? 1 : size_t(size.x)*size.y;
+      const int planesPerRead = (int)std::max<size_t>(1,(size_t(1)<<30)/(planeVoxels*sizeof(In)));
+      const int numReads = empty ? 0 : (size.z+planesPerRead-1)/planesPerRead;
+      int maxReads = 0;
+      MPI_Allreduce((void *)&numReads,&maxReads,1,MPI_INT,MPI_MAX,MPI_COMM_WORLD);
+
+      std::vector<In> buffer(empty ? 0 : planeVoxels*std::min(planesPerRead,size.z));
+      for (int r=0;r<maxReads;r++) {
+        const int z0 = r*planesPerRead;
+        const int nz = r < numReads ? std::min(planesPerRead,size.z-z0) : 0;
+        MPI_Datatype slab = voxel;
+        if (nz > 0) {
+          int sizes[3]    = {dims.z,dims.y,dims.x};
+          int subsizes[3] = {nz,size.y,size.x};
+          int starts[3]   = {box.lower.z+z0,box.lower.y,box.lower.x};
+          MPI_Type_create_subarray(3,sizes,subsizes,starts,MPI_ORDER_C,voxel,&slab);
+          MPI_Type_commit(&slab);
+        }
+        MPI_File_set_view(file,0,voxel,slab,(char *)"native",MPI_INFO_NULL);
+        MPI_Status status;
+        MPI_File_read_all(file,buffer.data(),nz > 0 ? int(planeVoxels*nz) : 0,voxel,&status);
+        if (nz == 0)
+          continue;
+        MPI_Type_free(&slab);
+        tasking::parallel_for(nz,[&](int iz){
+            const In *plane = buffer.data()+planeVoxels*iz;
+            for (int iy=0;iy<size.y;iy++)
+              for (int ix=0;ix<size.x;ix++)
+                out.set(vec3i(ix,iy,z0+iz),(T)plane[ix+size_t(size.x)*iy]);
+          });
+      }
+      MPI_Type_free(&voxel);
+      MPI_File_close(&file);
+    }
+
+    /*! with --mpi, the box of blocks this rank builds */
+    inline box3i rankBlockBox(const vec3i &rootGridSize,
+                              const std::string &partitionFile)
+    {
+      int rank = 0, numRanks = 1;
+      MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+      MPI_Comm_size(MPI_COMM_WORLD,&numRanks);
+      // the trees of a rank form a box, so its input is a single slab
+      const TreePartition partition = partitionFile.empty()
+        ? TreePartition::kdSplit(rootGridSize,numRanks)
+        : TreePartition::load(partitionFile);
+      if (!(partition.gridSize == rootGridSize) || partition.numRanks() != numRanks)
+        throw std::runtime_error("partition file "+partitionFile
+                                 +" does not match this forest and "
+                                 +std::to_string(numRanks)+" ranks");
+      return partition.rankBox[rank];
+    }
+
+    inline std::vector<int> blocksInBox(const box3i &trees,
+                                        const vec3i &rootGridSize)
+    {
+      std::vector<int> blocks;
+      for (int z=trees.lower.z;z<trees.upper.z;z++)
+        for (int y=trees.lower.y;y<trees.upper.y;y++)
+          for (int x=trees.lower.x;x<trees.upper.x;x++)
+            blocks.push_back(x+rootGridSize.x*(y+rootGridSize.y*z));
+      return blocks;
+    }
+
+    /*! build 'blocks' in parallel and write their files; 'voxel' gives
+        the input at a voxel of the whole (clipped) input. returns the
+        blocks' manifest entries */
+    template<int N, typename T, typename Voxel>
+    std::vector<BrickTreeManifestEntry> buildBlocks(const std::vector<int> &blocks,
+                                                    const vec3i &rootGridSize,
+                                                    const int blockWidth,
+                                                    const vec3i &inputSize,
+                                                    const float threshold,
+                                                    const std::string &outFileName,
+                                                    const Voxel &voxel)
+    {
+      std::vector<BrickTreeManifestEntry> entries(blocks.size());
+      tasking::parallel_for(blocks.size(),[&](size_t i){
+          const int blockID = blocks[i];
+          vec3i blockIdx;
+          blockIdx.z = blockID / (rootGridSize.x*rootGridSize.y);
+          blockIdx.y = (blockID / rootGridSize.x) % rootGridSize.y;
+          blockIdx.x = blockID % rootGridSize.x;
+          box3i blockDims;
+          blockDims.lower = blockIdx*blockWidth;
+          blockDims.upper = min(blockDims.lower+vec3i(blockWidth),inputSize);
+          std::shared_ptr<ActualArray3D<T>> blockInput = std::make_shared<ActualArray3D<T>>(blockDims.size());
+          for (int iz=0;iz<blockDims.size().z;iz++)
+            for (int iy=0;iy<blockDims.size().y;iy++)
+              for (int ix=0;ix<blockDims.size().x;ix++) {
+                const vec3i v(ix,iy,iz);
+                blockInput->set(v,voxel(blockDims.lower+v));
+              }
+          BlockBuilder<N,T> block(blockInput,blockWidth,threshold);
+          char blockOutName[outFileName.size()+100];
+          sprintf(blockOutName,"%s-brick%06i.osp",outFileName.c_str(),blockID);
+          entries[i] = block.save(blockOutName,blockInput->size());
+        });
+      return entries;
+    }
+
+    /*! write the forest's .osp and manifest from the manifest entries of
+        'blocks'; with 'useMPI' every rank passes its own blocks and rank
+        0 gathers and writes them */
+    template<int N, typename T>
+    void saveForestAndManifest(const std::vector<int> &blocks,
+                               const std::vector<BrickTreeManifestEntry> &blockEntries,
+                               const vec3i &rootGridSize,
+                               const int blockWidth,
+                               const vec3i &inputSize,
+                               const std::string &outFileName,
+                               bool useMPI)
+    {
+      const int numBlocks = rootGridSize.product();
+      int rank = 0, numRanks = 1;
+      std::vector<int> allBlocks = blocks;
+      std::vector<BrickTreeManifestEntry> allEntries = blockEntries;
+      if (useMPI) {
+        MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+        MPI_Comm_size(MPI_COMM_WORLD,&numRanks);
+        // rank 0 collects every block's manifest entry
+        const int myCount = blocks.size();
+        std::vector<int> counts(numRanks), displs(numRanks);
+        MPI_Gather((void *)&myCount,1,MPI_INT,counts.data(),1,MPI_INT,0,MPI_COMM_WORLD);
+        int total = 0;
+        for (int r=0;r<numRanks;r++) {
+          displs[r] = total;
+          total += counts[r];
+        }
+        allBlocks.resize(rank == 0 ? total : 0);
+        MPI_Gatherv((void *)blocks.data(),myCount,MPI_INT,
+                    allBlocks.data(),counts.data(),displs.data(),MPI_INT,0,MPI_COMM_WORLD);
+        const int entryBytes = sizeof(BrickTreeManifestEntry);
+        std::vector<int> byteCounts(numRanks), byteDispls(numRanks);
+        for (int r=0;r<numRanks;r++) {
+          byteCounts[r] = counts[r]*entryBytes;
+          byteDispls[r] = displs[r]*entryBytes;
+        }
+        allEntries.resize(rank == 0 ? total : 0);
+        MPI_Gatherv((void *)blockEntries.data(),myCount*entryBytes,MPI_BYTE,
+                    allEntries.data(),byteCounts.data(),byteDispls.data(),MPI_BYTE,
+                    0,MPI_COMM_WORLD);
+      }
+
+      if (rank == 0) {
+        if ((int)allBlocks.size() != numBlocks)
+          throw std::runtime_error("partition covers "+std::to_string(allBlocks.size())
+                                   +" of "+std::to_string(numBlocks)+" blocks");
+        std::vector<BrickTreeManifestEntry> entries(numBlocks);
+        for (size_t i=0;i<allBlocks.size();i++)
+          entries[allBlocks[i]] = allEntries[i];
+        saveForest<N,T>(outFileName,rootGridSize,blockWidth,inputSize);
+        const std::string manifest = manifestFileName(FileName(outFileName+".osp").dropExt());
+        const BrickTreeManifestHeader header =
+          BrickTreeManifestHeader::make(numBlocks,N,sizeof(T));
+        writeManifestFile(manifest,header,entries);
+        cout << "done writing forest '" << outFileName << ".osp' and its manifest" << endl;
+      }
+      if (useMPI)
+        MPI_Barrier(MPI_COMM_WORLD);
+    }
+
+    /*! --mpi: every rank reads the slab of the trees it is assigned with
+        collective I/O, builds those trees and writes their per-block
+        files; rank 0 gathers the manifest entries and writes the forest's
+        .osp and manifest, so the forest opens without a scan */
+    template<int N, typename T>
+    void buildForestMPI(const std::string &inputFormat,
+                        const vec3i &dims,
+                        const std::vector<std::string> &inFileName,
+                        const std::string &outFileName,
+                        const box3i &clipBox,
+                        const float threshold,
+                        const int blockDepth,
+                        const std::string &partitionFile)
+    {
+      int rank = 0, numRanks = 1;
+      MPI_Comm_rank(MPI_COMM_WORLD,&rank);
+      MPI_Comm_size(MPI_COMM_WORLD,&numRanks);
+      if (inFileName.size() != 1)
+        throw std::runtime_error("--mpi needs a single RAW input file");
+
+      int blockWidth = 1;
+      for (int i=0;i<blockDepth;i++)
+        blockWidth *= N;
+      const vec3i inputSize = clipBox.size();
+      const vec3i rootGridSize = divRoundUp(inputSize,vec3i(blockWidth));
+      const int numBlocks = rootGridSize.product();
+      if (numBlocks >= 1000000)
+        throw std::runtime_error("too many blocks ... consider changing bricksisze or block depth");
+
+      const box3i trees = rankBlockBox(rootGridSize,partitionFile);
+      const box3i voxels(min(trees.lower*blockWidth,inputSize),
+                         min(trees.upper*blockWidth,inputSize));
+      const vec3i slabSize = max(vec3i(0),voxels.size());
+      if (rank == 0)
+        cout << "building " << numBlocks << " blocks on " << numRanks << " ranks" << endl;
+      cout << "rank " << rank << ": blocks " << trees << ", voxels " << voxels << endl;
+
+      ActualArray3D<T> slab(slabSize);
+      const box3i fileBox(clipBox.lower+voxels.lower,clipBox.lower+voxels.lower+slabSize);
+      if (inputFormat == "")
+        readBoxCollective<T,T>(inFileName[0],dims,fileBox,slab);
+      else if (inputFormat == "uint8")
+        readBoxCollective<uint8_t,T>(inFileName[0],dims,fileBox,slab);
+      else if (inputFormat == "float")
+        readBoxCollective<float,T>(inFileName[0],dims,fileBox,slab);
+      else if (inputFormat == "double")
+        readBoxCollective<double,T>(inFileName[0],dims,fileBox,slab);
+      else
+        throw std::runtime_error("unsupported format '"+inputFormat+"'");
+
+      const std::vector<int> myBlocks = blocksInBox(trees,rootGridSize);
+      const std::vector<BrickTreeManifestEntry> myEntries =
+        buildBlocks<N,T>(myBlocks,rootGridSize,blockWidth,inputSize,threshold,outFileName,
+                         [&](const vec3i &v){ return slab.get(v-voxels.lower); });
+      cout << "rank " << rank << ": done building " << myBlocks.size() << " blocks" << endl;
+      saveForestAndManifest<N,T>(myBlocks,myEntries,rootGridSize,blockWidth,inputSize,
+                                 outFileName,true);
+    }
+
+    /*! --synthetic: build the whole forest of a procedural volume in
+        this process, blocks in parallel, or split between the ranks with
+        --mpi; nothing is read, every block computes its own voxels */
+    template<int N, typename T>
+    void buildSyntheticForest(const SyntheticField &field,
+                              const std::string &outFileName,
+                              const float threshold,
+                              const int blockDepth,
+                              bool useMPI,
+                              const std::string &partitionFile)
+    {
+      int blockWidth = 1;
+      for (int i=0;i<blockDepth;i++)
+        blockWidth *= N;
+      const vec3i inputSize = field.dims;
+      const vec3i rootGridSize = divRoundUp(inputSize,vec3i(blockWidth));
+      const int numBlocks = rootGridSize.product();
+      if (numBlocks >= 1000000)
+        throw std::runtime_error("too many blocks ... consider changing bricksisze or block depth");
+
+      const box3i trees = useMPI
+        ? rankBlockBox(rootGridSize,partitionFile)
+        : box3i(vec3i(0),rootGridSize);
+      const std::vector<int> myBlocks = blocksInBox(trees,rootGridSize);
+      cout << "building " << myBlocks.size() << " of " << numBlocks
+           << " blocks of a synthetic " << inputSize << " volume" << endl;
+      // fields are in [0,1]; integer voxels get their whole range
+      const float scale = std::is_integral<T>::value ? 255.f : 1.f;
+      const std::vector<BrickTreeManifestEntry> myEntries =
+        buildBlocks<N,T>(myBlocks,rootGridSize,blockWidth,inputSize,threshold,outFileName,
+                         [&](const vec3i &v){ return (T)(scale*field(v)); });
+      cout << "done building " << myBlocks.size() << " blocks" << endl;
+      saveForestAndManifest<N,T>(myBlocks,myEntries,rootGridSize,blockWidth,inputSize,
+                                 outFileName,useMPI);
+    }
+
     template<int N, typename T>
     void buildIt(int blockID,
                  const std::string &inputFormat,
@@ -210,8 +530,21 @@ namespace ospray {
                  const std::string &outFileName,
                  const box3i &clipBox,
                  const float threshold,
-                 const int blockDepth)
+                 const int blockDepth,
+                 bool useMPI,
+                 const std::string &partitionFile,
+                 const SyntheticField *synthetic)
     {
+      if (synthetic) {
+        buildSyntheticForest<N,T>(*synthetic,outFileName,threshold,blockDepth,
+                                  useMPI,partitionFile);
+        return;
+      }
+      if (useMPI) {
+        buildForestMPI<N,T>(inputFormat,dims,inFileName,outFileName,clipBox,
+                            threshold,blockDepth,partitionFile);
+        return;
+      }
       std::shared_ptr<Array3D<T>> org_input = openInput<T>(inputFormat,dims,inFileName);
       std::shared_ptr<Array3D<T>> input = std::make_shared<SubBoxArray3D<T>>(org_input,clipBox);
       // threshold = 0.f;
@@ -279,23 +612,11 @@ namespace ospray {
         cout << "done writing makefile." << endl;
         fclose(out);
 
-        const std::string ospFileName = outFileName+".osp";
-        FILE *osp = fopen(ospFileName.c_str(),"w");
-        fprintf(osp,"<?xml?>\n");
-        fprintf(osp,"<ospray>\n");
-        {
-          fprintf(osp,"<MultiBrickTree\n");
-          fprintf(osp,"   gridSize=\"%i %i %i\"\n",rootGridSize.x,rootGridSize.y,rootGridSize.z);
-          vec3i inputSize = input->size();
-          fprintf(osp,"   format=\"%s\"\n",typeToString<T>());
-          fprintf(osp,"   brickSize=\"%i\"\n",N);
-          fprintf(osp,"   blockWidth=\"%i\"\n",blockWidth);
-          fprintf(osp,"   validSize=\"%i %i %i\"\n",inputSize.x,inputSize.y,inputSize.z);
-          fprintf(osp,"\t/>\n");
-        }
-        fprintf(osp,"</ospray>\n");
-        fclose(osp);
+        saveForest<N,T>(outFileName,rootGridSize,blockWidth,input->size());
         cout << "done writing multibrick scene graph '.osp' file name..." << endl;
+        // the blocks are about to be rebuilt; the renderer writes a new
+        // manifest once they are
+        remove(manifestFileName(FileName(outFileName+".osp").dropExt()).c_str());
         exit(0);
       } else {
         // =======================================================
@@ -328,6 +649,7 @@ namespace ospray {
         sprintf(blockOutName,"%s-brick%06i.osp",outFileName.c_str(),blockID);
         cout << "saving tree to " << blockOutName << endl;
         block.save(blockOutName,blockInput->size());
+        remove(manifestFileName(FileName(outFileName+".osp").dropExt()).c_str());
         cout << "done saving block's bricktree... exiting!" << endl;
         cout << "=========================================" << endl;
         exit(0);
@@ -335,7 +657,8 @@ namespace ospray {
     }
 
     template<int N, typename T>
-    void BlockBuilder<N,T>::save(const std::string &ospFileName, const vec3i &validSize)
+    BrickTreeManifestEntry BlockBuilder<N,T>::save(const std::string &ospFileName,
+                                                   const vec3i &validSize)
     {
       const std::string binFileName = ospFileName+"bin";
       FILE *bin = fopen(binFileName.c_str(),"wb");
@@ -384,6 +707,25 @@ namespace ospray {
       }
       fprintf(osp,"</ospray>\n");
       fclose(osp);
+
+      BrickTreeManifestEntry e;
+      e.numValueBricks  = this->valueBrick.size();
+      e.numIndexBricks  = this->indexBrick.size();
+      e.numBrickInfos   = this->indexBrickOf.size();
+      e.indexBricksOfs  = indexOfs;
+      e.valueBricksOfs  = dataOfs;
+      e.indexBrickOfOfs = indexBrickOfOfs;
+      e.avgValue        = averageValue;
+      e.nBrickSize      = N;
+      e.valueRange[0]   = valueRange.lower;
+      e.valueRange[1]   = valueRange.upper;
+      e.validSize[0]    = validSize.x;
+      e.validSize[1]    = validSize.y;
+      e.validSize[2]    = validSize.z;
+      // as BrickTree::mapOSP derives it from the block's .osp file
+      e.depth           = log(max(validSize.x,validSize.y,validSize.z))/log(N);
+      stampManifestEntry(e,binFileName);
+      return e;
     }
 
     template<int N>
@@ -395,14 +737,17 @@ namespace ospray {
                  const std::string &outFileName,
                  const box3i &clipBox,
                  const float threshold,
-                 const int blockDepth)
+                 const int blockDepth,
+                 bool useMPI,
+                 const std::string &partitionFile,
+                 const SyntheticField *synthetic)
     {
       if (treeFormat == "uint8")
-        buildIt<N,uint8_t>(blockID,inputFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
+        buildIt<N,uint8_t>(blockID,inputFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic);
       else if (treeFormat == "float")
-        buildIt<N,float>(blockID,inputFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
+        buildIt<N,float>(blockID,inputFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic);
       else if (treeFormat == "double")
-        buildIt<N,double>(blockID,inputFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
+        buildIt<N,double>(blockID,inputFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic);
       else 
         error("unsupported format");
     }
@@ -419,6 +764,13 @@ namespace ospray {
       vec3i       dims        = vec3i(0);
       int         brickSize   = 4;
       box3i       clipBox(vec3i(-1),vec3i(-1));
+      bool        useMPI      = false;
+      std::string partitionFile = "";
+      std::string syntheticField = "";
+      int         seed        = 0;
+      float       frequency   = 8.f;
+      float       emptiness   = 0.9f;
+      float       spectrum    = 5.f/3.f;
 
       for (int i=1;i<ac;i++) {
         const std::string arg = av[i];
@@ -463,11 +815,27 @@ namespace ospray {
           clipBox.upper.y += atof(av[++i]);
           clipBox.upper.z += atof(av[++i]);
         }
+        else if (arg == "--mpi")
+          useMPI = true;
+        else if (arg == "--partition")
+          partitionFile = av[++i];
+        else if (arg == "--synthetic")
+          syntheticField = av[++i];
+        else if (arg == "--seed")
+          seed = atoi(av[++i]);
+        else if (arg == "--frequency")
+          frequency = atof(av[++i]);
+        else if (arg == "--emptiness")
+          emptiness = atof(av[++i]);
+        else if (arg == "--spectrum")
+          spectrum = atof(av[++i]);
         else if (arg[0] != '-')
           inFileName.push_back(av[i]);
         else
           error("unknown arg '"+arg+"'");
       }
+      if (useMPI)
+        MPI_Init(&ac,&av);
       if (clipBox.lower == vec3i(-1))
         clipBox.lower = vec3i(0);
       if (clipBox.upper == vec3i(-1))
@@ -479,37 +847,56 @@ namespace ospray {
       
       if (dims == vec3i(0))
         error("no input dimensions (-dims) specified");
-      if (inFileName.empty())
+      if (inFileName.empty() && syntheticField == "")
         error("no input file(s) specified");
       if (outFileName == "")
         error("no output file specified");
       
-      if (blockDepth < 0) {
-        blockDepth = (int)(logf(256.f)/logf(brickSize)+.5f);
-        cout << "automatically set block depth to " << blockDepth << endl;
+      // a rank that fails alone would leave the others blocked in their
+      // next collective; take the whole job down instead
+      try {
+        std::shared_ptr<SyntheticField> synthetic;
+        if (syntheticField != "") {
+          if (!inFileName.empty() || !(clipBox.lower == vec3i(0)) || !(clipBox.upper == dims))
+            error("--synthetic takes neither input files nor a clip box");
+          synthetic = std::make_shared<SyntheticField>(syntheticField,dims,seed,
+                                                       frequency,emptiness,spectrum);
+        }
+
+        if (blockDepth < 0) {
+          blockDepth = (int)(logf(256.f)/logf(brickSize)+.5f);
+          cout << "automatically set block depth to " << blockDepth << endl;
+        }
+        switch (brickSize) {
+        case 2:
+          buildIt<2>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic.get());
+          break;
+        case 4:
+          buildIt<4>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic.get());
+          break;
+        case 8:
+          buildIt<8>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic.get());
+          break;
+        case 16:
+          buildIt<16>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic.get());
+          break;
+        case 32:
+          buildIt<32>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic.get());
+          break;
+        case 64:
+          buildIt<64>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth,useMPI,partitionFile,synthetic.get());
+          break;
+        default:
+          error("unsupported brick size ...");
+        };
+      } catch (const std::exception &e) {
+        std::cerr << "Error: " << e.what() << endl;
+        if (useMPI)
+          MPI_Abort(MPI_COMM_WORLD,1);
+        return 1;
       }
-      switch (brickSize) {
-      case 2:
-        buildIt<2>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
-        break;
-      case 4:
-        buildIt<4>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
-        break;
-      case 8:
-        buildIt<8>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
-        break;
-      case 16:
-        buildIt<16>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
-        break;
-      case 32:
-        buildIt<32>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
-        break;
-      case 64:
-        buildIt<64>(blockID,inputFormat,treeFormat,dims,inFileName,outFileName,clipBox,threshold,blockDepth);
-        break;
-      default:
-        error("unsupported brick size ...");
-      };
+      if (useMPI)
+        MPI_Finalize();
       return 0;
     }
 
@@ -0,0 +1,74 @@
+#!/usr/bin/env python3
+# Local stand-in for an object store: serves a directory over http with
+# keep-alive connections and single byte range requests, so the http
+# brick source (-brick-url) can be tried without a real bucket.
+#
+#   ./rangeServer.py <forest dir> [port]
+#   ./ospBrickBench magnetic-bt.osp -brick-url http://localhost:8000 ...
+
+import os
+import re
+import sys
+from http.server import SimpleHTTPRequestHandler, ThreadingHTTPServer
+
+
+class RangeHandler(SimpleHTTPRequestHandler):
+    protocol_version = "HTTP/1.1"
+
+    def do_HEAD(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+        self.send_response(200)
+        self.send_file_headers(path)
+        self.send_header("Content-Length", str(os.path.getsize(path)))
+        self.end_headers()
+
+    def send_file_headers(self, path):
+        # lets clients tell a rewritten file from the one they cached
+        self.send_header("Accept-Ranges", "bytes")
+        self.send_header("Last-Modified",
+                         self.date_time_string(os.path.getmtime(path)))
+
+    def do_GET(self):
+        path = self.translate_path(self.path)
+        if not os.path.isfile(path):
+            self.send_error(404)
+            return
+        size = os.path.getsize(path)
+        begin, end = 0, size - 1
+        status = 200
+        match = re.match(r"bytes=(\d+)-(\d*)$", self.headers.get("Range", ""))
+        if match:
+            begin = int(match.group(1))
+            if match.group(2):
+                end = min(int(match.group(2)), size - 1)
+            if begin >= size:
+                self.send_response(416)
+                self.send_header("Content-Range", "bytes */%d" % size)
+                self.send_header("Content-Length", "0")
+                self.end_headers()
+                return
+            status = 206
+        self.send_response(status)
+        self.send_file_headers(path)
+        self.send_header("Content-Length", str(end - begin + 1))
+        if status == 206:
+            self.send_header("Content-Range",
+                             "bytes %d-%d/%d" % (begin, end, size))
+        self.end_headers()
+        with open(path, "rb") as f:
+            f.seek(begin)
+            self.wfile.write(f.read(end - begin + 1))
+
+    def log_message(self, format, *args):
+        pass
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        sys.exit("usage: rangeServer.py <dir> [port]")
+    os.chdir(sys.argv[1])
+    port = int(sys.argv[2]) if len(sys.argv) > 2 else 8000
+    ThreadingHTTPServer(("", port), RangeHandler).serve_forever()
@@ -0,0 +1,30 @@
+#!/bin/bash
+# Builds a synthetic forest (see ospRaw2Bricks --synthetic) of SIZE^3
+# voxels and renders it, so the numbers of the other scripts can be
+# reproduced at any scale without SCI's datasets:
+#
+#   ./synthetic.sh <dir with the binaries> <size> [field] [bench args...]
+#
+# field is noise, marschner-lobb, blobs or turbulence (default). The
+# forest is built once, under ./synthetic-<field>-<size>/.
+
+OSPRAY_DIR=$1
+SIZE=$2
+FIELD=${3:-turbulence}
+
+OUTPUTNAME=synthetic-$FIELD-$SIZE
+BRICKTREEFILE=$OUTPUTNAME/$OUTPUTNAME.osp
+
+if [ ! -f $BRICKTREEFILE ]
+then
+  mkdir -p $OUTPUTNAME
+  $OSPRAY_DIR/ospRaw2Bricks --synthetic $FIELD -dims $SIZE $SIZE $SIZE \
+    --format float -bs 4 -d 4 -t 0 -o $OUTPUTNAME/$OUTPUTNAME || exit 1
+fi
+
+CENTER=$((SIZE / 2))
+$OSPRAY_DIR/ospBrickBench $BRICKTREEFILE -valueRange 0 1 \
+  -vp $((SIZE * 2)) $((SIZE * 3 / 2)) $((SIZE * 2)) \
+  -vi $CENTER $CENTER $CENTER -vu 0 1 0 \
+  -o $OUTPUTNAME \
+  "${@:4}"
@@ -0,0 +1,390 @@
+// ======================================================================== //
+// Copyright 2009-2017 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+// ospcommon
+#include "ospcommon/malloc.h"
+// std
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#ifdef __linux__
+#  include <fcntl.h>
+#  include <pthread.h>
+#  include <sched.h>
+#  include <sys/mman.h>
+#  include <sys/stat.h>
+#  include <sys/syscall.h>
+#  include <unistd.h>
+#endif
+
+namespace ospray {
+namespace bt
+{
+
+/*! one contiguous allocation holding the bricks of every tree of a
+    forest. the forest lays out its regions with a Layout first and then
+    allocates everything at once, so opening a tree costs no allocation
+    of its own and trees never own (or leak) brick memory. move-only;
+    the memory is released when the arena goes away.
+
+    an arena can also live in a named POSIX shared memory segment, so
+    the processes of a node that open the same forest share one copy:
+    the first process creates the segment and owns it, later ones attach
+    to it. the owner removes the name again when its arena goes away */
+class BrickArena
+{
+public:
+  static const size_t alignment = 64;
+  static const size_t hugePageSize = size_t(2) << 20;
+
+  enum NumaPolicy
+  {
+    NUMA_NONE,       // first touch
+    NUMA_INTERLEAVE, // pages round-robin over all nodes
+    NUMA_PARTITION   // contiguous ranges of trees per node
+  };
+
+  /*! where the arena's pages go; only honored on linux */
+  struct Placement
+  {
+    Placement() : hugePages(false), numa(NUMA_NONE), attachOnly(false) {}
+
+    bool hugePages;
+    NumaPolicy numa;
+    //! name of a shared memory segment (e.g. "/bt-magnetic") to place
+    //  the arena in; empty for memory private to this process. shared
+    //  arenas do not use huge pages
+    std::string sharedName;
+    //! never create the shared segment, only attach to one another
+    //  process (e.g. a brick server) owns
+    bool attachOnly;
+  };
+
+  /*! accumulates the cache line aligned regions of an arena */
+  struct Layout
+  {
+    /*! reserve 'bytes', returns the region's offset into the arena */
+    size_t add(size_t bytes)
+    {
+      const size_t ofs = (size + alignment - 1) / alignment * alignment;
+      size = ofs + bytes;
+      return ofs;
+    }
+
+    size_t size = 0;
+  };
+
+  BrickArena() = default;
+
+  explicit BrickArena(const Layout &layout,
+                      const Placement &placement = Placement())
+    : bytes(layout.size)
+  {
+    if (bytes == 0)
+      return;
+#ifdef __linux__
+    if (!placement.sharedName.empty()) {
+      mapShared(placement.sharedName, placement.attachOnly);
+      return;
+    }
+    if (placement.hugePages || placement.numa != NUMA_NONE) {
+      mapPages(placement.hugePages);
+      return;
+    }
+#endif
+    base = (uint8_t *)alignedMalloc(bytes, alignment);
+    if (!base)
+      throw std::runtime_error("could not allocate brick arena of "
+                               + std::to_string(bytes) + " bytes");
+  }
+
+  BrickArena(const BrickArena &) = delete;
+  BrickArena &operator=(const BrickArena &) = delete;
+
+  BrickArena(BrickArena &&other)
+    : base(other.base), bytes(other.bytes),
+      mapped(other.mapped), hugeTLB(other.hugeTLB),
+      owner(other.owner), sharedName(std::move(other.sharedName))
+  {
+    other.base    = nullptr;
+    other.bytes   = 0;
+    other.mapped  = 0;
+    other.hugeTLB = false;
+    other.owner   = true;
+    other.sharedName.clear();
+  }
+
+  BrickArena &operator=(BrickArena &&other)
+  {
+    if (this != &other) {
+      release();
+      std::swap(base, other.base);
+      std::swap(bytes, other.bytes);
+      std::swap(mapped, other.mapped);
+      std::swap(hugeTLB, other.hugeTLB);
+      std::swap(owner, other.owner);
+      std::swap(sharedName, other.sharedName);
+    }
+    return *this;
+  }
+
+  ~BrickArena()
+  {
+    release();
+  }
+
+  template<typename T>
+  T *at(size_t ofs) const
+  {
+    return (T *)(base + ofs);
+  }
+
+  /*! zero a region, e.g. residency bitsets */
+  void clear(size_t ofs, size_t size)
+  {
+    memset(base + ofs, 0, size);
+  }
+
+  uint8_t *data() const
+  { return base; }
+
+  size_t size() const
+  { return bytes; }
+
+  /*! false if this process attached to a shared arena another process
+      created (and fills); private arenas are always their own */
+  bool isOwner() const
+  { return owner; }
+
+  /*! remove a shared arena's name, e.g. one left over by a process that
+      died; processes still attached keep their mapping */
+  static void removeShared(const std::string &name)
+  {
+#ifdef __linux__
+    shm_unlink(name.c_str());
+#endif
+  }
+
+  /*! spread the pages of a region over all numa nodes; has to be
+      called before the region is first touched */
+  void interleave(size_t ofs, size_t size)
+  {
+    const int nodes = numNumaNodes();
+    if (nodes > 1)
+      bindPages(ofs, size, MPOL_INTERLEAVE_, (uint64_t(1) << nodes) - 1);
+  }
+
+  /*! prefer placing the pages of a region on 'node'; pages straddling
+      the region's ends are left to the neighboring regions */
+  void place(size_t ofs, size_t size, int node)
+  {
+    if (numNumaNodes() > 1)
+      bindPages(ofs, size, MPOL_PREFERRED_, uint64_t(1) << node);
+  }
+
+  /*! number of numa nodes of this machine (1 if unknown) */
+  static int numNumaNodes()
+  {
+    static const int nodes = [] {
+      const std::vector<int> ids =
+        parseCpuList("/sys/devices/system/node/online");
+      return ids.empty() ? 1 : std::min(64, ids.back() + 1);
+    }();
+    return nodes;
+  }
+
+  /*! restrict a thread to the cpus of a numa node */
+  static void pinToNode(std::thread &thread, int node)
+  {
+#ifdef __linux__
+    const std::vector<int> cpus = parseCpuList(
+      "/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+    if (cpus.empty())
+      return;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    for (int cpu : cpus)
+      CPU_SET(cpu, &set);
+    pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set);
+#endif
+  }
+
+private:
+  // linux mempolicy modes, see mbind(2)
+  static const int MPOL_PREFERRED_  = 1;
+  static const int MPOL_INTERLEAVE_ = 3;
+
+  /*! parse a sysfs list such as "0-3,8-11" */
+  static std::vector<int> parseCpuList(const std::string &fileName)
+  {
+    std::vector<int> ids;
+    std::ifstream in(fileName);
+    std::string range;
+    while (std::getline(in, range, ',')) {
+      int lo = 0, hi = 0;
+      const int n = sscanf(range.c_str(), "%d-%d", &lo, &hi);
+      if (n < 1)
+        continue;
+      if (n == 1)
+        hi = lo;
+      for (int i = lo; i <= hi; i++)
+        ids.push_back(i);
+    }
+    return ids;
+  }
+
+  void bindPages(size_t ofs, size_t size, int mode, uint64_t nodeMask)
+  {
+#ifdef __linux__
+    if (!mapped)
+      return;
+    const size_t page = pageSize();
+    const size_t begin = (ofs + page - 1) / page * page;
+    const size_t end   = (ofs + size) / page * page;
+    if (end <= begin)
+      return;
+    // best effort: on failure the pages simply stay first touch
+    syscall(SYS_mbind, base + begin, end - begin, mode, &nodeMask,
+            sizeof(nodeMask) * 8, 0);
+#endif
+  }
+
+#ifdef __linux__
+  /*! create the named segment, or attach to it if another process was
+      first; an attacher waits until the creator has sized it */
+  void mapShared(const std::string &name, bool attachOnly)
+  {
+    int fd = -1;
+    if (attachOnly) {
+      errno = EEXIST;
+    } else {
+      fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    }
+    owner = fd >= 0;
+    if (owner) {
+      if (ftruncate(fd, bytes) != 0) {
+        close(fd);
+        shm_unlink(name.c_str());
+        throw std::runtime_error("could not size shared brick arena "
+                                 + name + " to " + std::to_string(bytes)
+                                 + " bytes");
+      }
+    } else {
+      if (errno != EEXIST || (fd = shm_open(name.c_str(), O_RDWR, 0600)) < 0)
+        throw std::runtime_error("could not open shared brick arena " + name
+                                 + (attachOnly ? ", is its owner running?"
+                                               : ""));
+      struct stat st;
+      for (int i = 0; fstat(fd, &st) == 0 && size_t(st.st_size) < bytes; i++) {
+        if (i == 10000) {
+          close(fd);
+          throw std::runtime_error("shared brick arena " + name
+                                   + " does not match this forest");
+        }
+        usleep(1000);
+      }
+    }
+    void *ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (ptr == MAP_FAILED) {
+      if (owner)
+        shm_unlink(name.c_str());
+      throw std::runtime_error("could not map shared brick arena " + name);
+    }
+    base       = (uint8_t *)ptr;
+    mapped     = bytes;
+    sharedName = name;
+  }
+
+  /*! anonymous mapping, backed by 2MB pages if possible: explicit huge
+      pages first, then transparent huge pages, then regular pages */
+  void mapPages(bool hugePages)
+  {
+    void *ptr = MAP_FAILED;
+    if (hugePages) {
+      const size_t size = (bytes + hugePageSize - 1) / hugePageSize * hugePageSize;
+      ptr = mmap(nullptr, size, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (ptr != MAP_FAILED) {
+        mapped = size;
+        hugeTLB = true;
+      }
+    }
+    if (ptr == MAP_FAILED) {
+      ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (ptr == MAP_FAILED)
+        throw std::runtime_error("could not map brick arena of "
+                                 + std::to_string(bytes) + " bytes");
+      mapped = bytes;
+      if (hugePages)
+        madvise(ptr, bytes, MADV_HUGEPAGE);
+    }
+    base = (uint8_t *)ptr;
+  }
+#endif
+
+  size_t pageSize() const
+  {
+#ifdef __linux__
+    return hugeTLB ? hugePageSize : (size_t)sysconf(_SC_PAGESIZE);
+#else
+    return 4096;
+#endif
+  }
+
+  void release()
+  {
+#ifdef __linux__
+    if (owner && !sharedName.empty())
+      shm_unlink(sharedName.c_str());
+    if (base && mapped)
+      munmap(base, mapped);
+    else
+#endif
+    if (base)
+      alignedFree(base);
+    base    = nullptr;
+    bytes   = 0;
+    mapped  = 0;
+    hugeTLB = false;
+    owner   = true;
+    sharedName.clear();
+  }
+
+  uint8_t *base  = nullptr;
+  size_t bytes   = 0;
+  //! size of the mmap'ed range, 0 if the arena came from alignedMalloc
+  size_t mapped  = 0;
+  bool hugeTLB   = false;
+  //! false if attached to a shared arena created by another process
+  bool owner     = true;
+  //! name of the shared memory segment, empty for private arenas
+  std::string sharedName;
+};
+
+}  // namespace bt
+}  // namespace ospray
@@ -0,0 +1,198 @@
+// ======================================================================== //
+// Copyright 2009-2017 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+// std
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#ifdef __linux__
+#  include <sys/socket.h>
+#  include <sys/un.h>
+#  include <unistd.h>
+#endif
+
+namespace ospray {
+namespace bt
+{
+
+/*! the brick server (ospBrickServer) owns a forest's brick arena in a
+    shared memory segment and keeps it warm across client runs. clients
+    map the segment and read bricks straight from it; the unix socket is
+    only the control path. every message is a BrickServerMessage
+    followed by 'count' records of the op's payload type */
+enum BrickServerOp : uint32_t
+{
+  BRICK_SERVER_HELLO   = 1, // -> BrickServerHello
+  BRICK_SERVER_REQUEST = 2, // BrickServerRequest[count], no reply
+  BRICK_SERVER_CANCEL  = 3, // drop the client's background requests
+  BRICK_SERVER_STATUS  = 4  // -> BrickServerStatus
+};
+
+struct BrickServerMessage
+{
+  uint32_t magic;
+  uint32_t op;
+  uint32_t count;
+  uint32_t reserved;
+
+  static const uint32_t MAGIC = 0x51524242; // "BBRQ"
+};
+
+/*! a brick a client wants. priority 0 means needed now, it is loaded
+    like a renderer's own request; higher priorities are background
+    loads that run lowest priority first once nothing is needed now. a
+    request replaces all earlier background requests of the client */
+struct BrickServerRequest
+{
+  int32_t treeID;
+  int32_t brickID;
+  int32_t priority;
+};
+
+struct BrickServerHello
+{
+  char sharedName[256];
+  uint32_t numTrees;
+  int32_t brickSize;
+};
+
+struct BrickServerStatus
+{
+  uint64_t generation;
+  uint64_t pendingBricks;
+};
+
+#ifdef __linux__
+inline bool sendAll(int fd, const void *data, size_t size)
+{
+  const char *ptr = (const char *)data;
+  while (size > 0) {
+    const ssize_t n = send(fd, ptr, size, MSG_NOSIGNAL);
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+
+inline bool recvAll(int fd, void *data, size_t size)
+{
+  char *ptr = (char *)data;
+  while (size > 0) {
+    const ssize_t n = recv(fd, ptr, size, 0);
+    if (n <= 0)
+      return false;
+    ptr += n;
+    size -= n;
+  }
+  return true;
+}
+#endif
+
+/*! client end of a brick server's control socket; thread safe. brick
+    servers need linux, elsewhere connecting throws */
+class BrickServerConnection
+{
+public:
+  explicit BrickServerConnection(const std::string &socketPath)
+  {
+#ifdef __linux__
+    fd = socket(AF_UNIX, SOCK_STREAM, 0);
+    sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (socketPath.size() >= sizeof(addr.sun_path))
+      throw std::runtime_error("brick server socket path too long: "
+                               + socketPath);
+    strcpy(addr.sun_path, socketPath.c_str());
+    if (fd < 0 || connect(fd, (sockaddr *)&addr, sizeof(addr)) != 0) {
+      if (fd >= 0)
+        close(fd);
+      throw std::runtime_error("could not connect to brick server at "
+                               + socketPath);
+    }
+#else
+    throw std::runtime_error("brick servers are only supported on linux");
+#endif
+  }
+
+  BrickServerConnection(const BrickServerConnection &) = delete;
+  BrickServerConnection &operator=(const BrickServerConnection &) = delete;
+
+  ~BrickServerConnection()
+  {
+#ifdef __linux__
+    close(fd);
+#endif
+  }
+
+  BrickServerHello hello()
+  {
+    BrickServerHello reply;
+    roundTrip(BRICK_SERVER_HELLO, &reply, sizeof(reply));
+    reply.sharedName[sizeof(reply.sharedName) - 1] = 0;
+    return reply;
+  }
+
+  void request(const std::vector<BrickServerRequest> &bricks)
+  {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(mtx);
+    const BrickServerMessage msg{BrickServerMessage::MAGIC,
+                                 BRICK_SERVER_REQUEST,
+                                 uint32_t(bricks.size()), 0};
+    if (!sendAll(fd, &msg, sizeof(msg))
+        || !sendAll(fd, bricks.data(), bricks.size() * sizeof(bricks[0])))
+      throw std::runtime_error("lost connection to brick server");
+#endif
+  }
+
+  void cancel()
+  {
+    roundTrip(BRICK_SERVER_CANCEL, nullptr, 0);
+  }
+
+  BrickServerStatus status()
+  {
+    BrickServerStatus reply;
+    roundTrip(BRICK_SERVER_STATUS, &reply, sizeof(reply));
+    return reply;
+  }
+
+private:
+  void roundTrip(BrickServerOp op, void *reply, size_t replySize)
+  {
+#ifdef __linux__
+    std::lock_guard<std::mutex> lock(mtx);
+    const BrickServerMessage msg{BrickServerMessage::MAGIC, op, 0, 0};
+    if (!sendAll(fd, &msg, sizeof(msg))
+        || (replySize && !recvAll(fd, reply, replySize)))
+      throw std::runtime_error("lost connection to brick server");
+#endif
+  }
+
+  int fd = -1;
+  std::mutex mtx;
+};
+
+}  // namespace bt
+}  // namespace ospray
@@ -0,0 +1,715 @@
+// ======================================================================== //
+// Copyright 2009-2017 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+// own
+#include "BrickSource.h"
+
+// std
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+// posix
+#include <fcntl.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+namespace ospray {
+  namespace bt {
+
+    std::string BrickSource::treeFile(size_t treeID, const char *ext) const
+    {
+      char suffix[64];
+      snprintf(suffix, sizeof(suffix), "-brick%06i.%s", (int)treeID, ext);
+      return baseName + suffix;
+    }
+
+    std::shared_ptr<BrickSource> BrickSource::open(
+      const std::string &brickFileBase, const std::string &url,
+      const std::string &cacheDir, int numConnections)
+    {
+      if (url.empty())
+        return std::make_shared<FileBrickSource>(brickFileBase);
+      if (url.compare(0, 7, "http://") == 0)
+        return std::make_shared<HttpBrickSource>(
+          brickFileBase, url, cacheDir.empty() ? "/tmp/bt-cache" : cacheDir,
+          std::max(1, numConnections));
+      throw std::runtime_error("unsupported brick source url '" + url
+                               + "' (only http:// is supported)");
+    }
+
+    static void splitPath(const std::string &brickFileBase,
+                          std::string &dir, std::string &base)
+    {
+      const size_t slash = brickFileBase.rfind('/');
+      if (slash == std::string::npos) {
+        dir  = "";
+        base = brickFileBase;
+      } else {
+        dir  = brickFileBase.substr(0, slash);
+        base = brickFileBase.substr(slash + 1);
+      }
+    }
+
+    // =======================================================
+    // local files
+    // =======================================================
+
+    FileBrickSource::FileBrickSource(const std::string &brickFileBase)
+    {
+      splitPath(brickFileBase, dir, baseName);
+    }
+
+    std::string FileBrickSource::localPath(const std::string &name)
+    {
+      return dir.empty() ? name : dir + "/" + name;
+    }
+
+    bool FileBrickSource::fileStamp(const std::string &name, uint64_t &bytes,
+                                    int64_t &mtime)
+    {
+      struct stat st;
+      if (stat(localPath(name).c_str(), &st) != 0)
+        return false;
+      bytes = st.st_size;
+      mtime = st.st_mtime;
+      return true;
+    }
+
+    void FileBrickSource::read(const std::string &name,
+                               std::vector<Range> ranges)
+    {
+      const std::string path = localPath(name);
+      const int fd = ::open(path.c_str(), O_RDONLY);
+      if (fd < 0)
+        throw std::runtime_error("could not open brick bin file " + path);
+      // in file order, so the reads of a batch sweep the file once
+      std::sort(ranges.begin(), ranges.end(),
+                [](const Range &a, const Range &b)
+                { return a.offset < b.offset; });
+      for (const Range &r : ranges) {
+        char *dst = (char *)r.dst;
+        uint64_t done = 0;
+        while (done < r.size) {
+          const ssize_t n = pread(fd, dst + done, r.size - done, r.offset + done);
+          if (n <= 0) {
+            close(fd);
+            throw std::runtime_error("short read from brick bin file " + path);
+          }
+          done += n;
+        }
+        bytesRead += r.size;
+      }
+      close(fd);
+    }
+
+    // =======================================================
+    // http range requests
+    // =======================================================
+
+    typedef std::shared_ptr<const std::vector<char>> Chunk;
+
+    struct HttpBrickSource::State
+    {
+      std::string host, port, path;
+      //! cache directory of this url
+      std::string cacheDir;
+      int maxConnections;
+
+      //! keep-alive connections not in use, and the number open
+      std::mutex poolMtx;
+      std::condition_variable poolCond;
+      std::vector<int> idle;
+      int numOpen = 0;
+
+      //! what a HEAD request told about a file
+      struct FileInfo
+      {
+        //! size and ETag (or Last-Modified) of the file; cached chunks
+        //! of another version of it are never used
+        std::string version;
+        //! false if the server does not advertise byte ranges
+        bool ranges;
+      };
+      std::mutex infoMtx;
+      std::map<std::string, std::shared_future<FileInfo>> info;
+
+      //! chunks being fetched, by "<name>#<chunk>"
+      std::mutex flightMtx;
+      std::map<std::string, std::shared_future<Chunk>> inFlight;
+
+      //! one fetch thread per connection, alive as long as the source
+      std::mutex jobMtx;
+      std::condition_variable jobCond;
+      std::deque<std::function<void()>> jobs;
+      std::vector<std::thread> fetchers;
+      bool quit = false;
+
+      struct Response
+      {
+        int status = 0;
+        bool keepAlive = false;
+        //! by lower case name
+        std::map<std::string, std::string> headers;
+        std::vector<char> body;
+      };
+
+      int acquire();
+      void release(int fd, bool reuse);
+      int connectTo();
+      /*! send 'method' for [begin,end) of 'name', or for the whole file
+          if 'end' is 0, on a pooled connection */
+      Response send(const char *method, const std::string &name,
+                    uint64_t begin, uint64_t end);
+      bool request(int fd, const std::string &request, bool head,
+                   Response &response);
+      /*! body of a GET of [begin,end) of 'name'; the whole file if
+          'end' is 0. bytes past the end of the file are left out */
+      std::vector<char> get(const std::string &name, uint64_t begin,
+                            uint64_t end);
+
+      FileInfo fileInfo(const std::string &name);
+      FileInfo head(const std::string &name);
+      void fetchLoop();
+
+      //! cache directory of the current version of file 'name'
+      std::string versionDir(const std::string &name)
+      { return cacheDir + "/" + name + "." + fileInfo(name).version; }
+      static std::string chunkFile(const std::string &dir, uint64_t chunk)
+      { return dir + "/" + std::to_string(chunk); }
+      Chunk readCache(const std::string &dir, uint64_t chunk) const;
+      void writeCache(const std::string &file,
+                      const char *data, size_t size) const;
+      //! put every chunk of a whole file into its cache directory 'dir'
+      void cacheWhole(const std::string &dir,
+                      const std::vector<char> &body) const;
+    };
+
+    static void makeDirs(const std::string &dir)
+    {
+      for (size_t pos = 0; pos != std::string::npos;) {
+        pos = dir.find('/', pos + 1);
+        mkdir(dir.substr(0, pos).c_str(), 0755);
+      }
+      struct stat st;
+      if (stat(dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode))
+        throw std::runtime_error("could not create brick cache directory "
+                                 + dir);
+    }
+
+    //! 's' with everything but letters, digits, '.' and '-' replaced
+    static std::string fileNameSafe(std::string s)
+    {
+      for (char &c : s)
+        if (!isalnum((unsigned char)c) && c != '.' && c != '-')
+          c = '_';
+      return s;
+    }
+
+    HttpBrickSource::HttpBrickSource(const std::string &brickFileBase,
+                                     const std::string &url,
+                                     const std::string &cacheDir,
+                                     int numConnections)
+      : state(new State)
+    {
+      std::string dir;
+      splitPath(brickFileBase, dir, baseName);
+
+      // http://host[:port][/path]
+      const std::string rest = url.substr(7);
+      const size_t slash = rest.find('/');
+      const std::string hostPort = rest.substr(0, slash);
+      state->path = slash == std::string::npos ? "" : rest.substr(slash);
+      while (!state->path.empty() && state->path.back() == '/')
+        state->path.pop_back();
+      const size_t colon = hostPort.find(':');
+      state->host = hostPort.substr(0, colon);
+      state->port = colon == std::string::npos ? "80" : hostPort.substr(colon + 1);
+      if (state->host.empty())
+        throw std::runtime_error("no host in brick source url '" + url + "'");
+      state->maxConnections = std::max(numConnections, 1);
+
+      // one cache directory per url
+      state->cacheDir = cacheDir + "/" + fileNameSafe(rest);
+      makeDirs(state->cacheDir);
+
+      State *s = state.get();
+      for (int i = 0; i < state->maxConnections; i++)
+        state->fetchers.emplace_back([s] { s->fetchLoop(); });
+    }
+
+    HttpBrickSource::~HttpBrickSource()
+    {
+      {
+        std::lock_guard<std::mutex> lock(state->jobMtx);
+        state->quit = true;
+      }
+      state->jobCond.notify_all();
+      for (auto &f : state->fetchers)
+        f.join();
+      for (int fd : state->idle)
+        close(fd);
+    }
+
+    void HttpBrickSource::State::fetchLoop()
+    {
+      for (;;) {
+        std::function<void()> job;
+        {
+          std::unique_lock<std::mutex> lock(jobMtx);
+          jobCond.wait(lock, [&] { return quit || !jobs.empty(); });
+          if (jobs.empty())
+            return;
+          job = std::move(jobs.front());
+          jobs.pop_front();
+        }
+        job();
+      }
+    }
+
+    int HttpBrickSource::State::connectTo()
+    {
+      addrinfo hints, *addrs = nullptr;
+      memset(&hints, 0, sizeof(hints));
+      hints.ai_family   = AF_UNSPEC;
+      hints.ai_socktype = SOCK_STREAM;
+      if (getaddrinfo(host.c_str(), port.c_str(), &hints, &addrs) != 0)
+        throw std::runtime_error("could not resolve brick source host " + host);
+      int fd = -1;
+      for (addrinfo *a = addrs; a && fd < 0; a = a->ai_next) {
+        fd = socket(a->ai_family, a->ai_socktype, a->ai_protocol);
+        if (fd >= 0 && connect(fd, a->ai_addr, a->ai_addrlen) != 0) {
+          close(fd);
+          fd = -1;
+        }
+      }
+      freeaddrinfo(addrs);
+      if (fd < 0)
+        throw std::runtime_error("could not connect to brick source "
+                                 + host + ":" + port);
+      return fd;
+    }
+
+    int HttpBrickSource::State::acquire()
+    {
+      {
+        std::unique_lock<std::mutex> lock(poolMtx);
+        poolCond.wait(lock, [&] {
+          return !idle.empty() || numOpen < maxConnections;
+        });
+        if (!idle.empty()) {
+          const int fd = idle.back();
+          idle.pop_back();
+          return fd;
+        }
+        numOpen++;
+      }
+      try {
+        return connectTo();
+      } catch (...) {
+        release(-1, false);
+        throw;
+      }
+    }
+
+    void HttpBrickSource::State::release(int fd, bool reuse)
+    {
+      std::lock_guard<std::mutex> lock(poolMtx);
+      if (reuse) {
+        idle.push_back(fd);
+      } else {
+        if (fd >= 0)
+          close(fd);
+        numOpen--;
+      }
+      poolCond.notify_one();
+    }
+
+    /*! send a request and read the response; false if the connection
+        broke before a complete response came back. the response to a
+        HEAD request has no body, whatever its content-length says */
+    bool HttpBrickSource::State::request(int fd, const std::string &request,
+                                         bool head, Response &response)
+    {
+      for (size_t sent = 0; sent < request.size();) {
+        const ssize_t n = ::send(fd, request.data() + sent,
+                                 request.size() - sent, MSG_NOSIGNAL);
+        if (n <= 0)
+          return false;
+        sent += n;
+      }
+
+      // header, and whatever part of the body came with it
+      std::string header;
+      char buffer[16384];
+      size_t headerEnd = std::string::npos;
+      while (headerEnd == std::string::npos) {
+        const ssize_t n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+          return false;
+        header.append(buffer, n);
+        headerEnd = header.find("\r\n\r\n");
+      }
+      const std::string rest = header.substr(headerEnd + 4);
+      header.resize(headerEnd);
+
+      std::istringstream lines(header);
+      std::string line, version;
+      std::getline(lines, line);
+      std::istringstream(line) >> version >> response.status;
+      response.keepAlive = version != "HTTP/1.0";
+      int64_t contentLength = -1;
+      while (std::getline(lines, line)) {
+        const size_t colon = line.find(':');
+        if (colon == std::string::npos)
+          continue;
+        std::string key = line.substr(0, colon);
+        std::string value = line.substr(colon + 1);
+        std::transform(key.begin(), key.end(), key.begin(), ::tolower);
+        value.erase(0, value.find_first_not_of(' '));
+        while (!value.empty() && (value.back() == '\r' || value.back() == ' '))
+          value.pop_back();
+        response.headers[key] = value;
+        std::transform(value.begin(), value.end(), value.begin(), ::tolower);
+        if (key == "content-length")
+          contentLength = std::stoll(value);
+        else if (key == "connection")
+          response.keepAlive = value != "close";
+        else if (key == "transfer-encoding" && value != "identity")
+          throw std::runtime_error("brick source " + host
+                                   + " sent an unsupported transfer encoding");
+      }
+
+      std::vector<char> &body = response.body;
+      if (head)
+        return true;
+      body.assign(rest.begin(), rest.end());
+      if (contentLength < 0) {
+        // body runs until the server closes the connection
+        response.keepAlive = false;
+        for (ssize_t n; (n = recv(fd, buffer, sizeof(buffer), 0)) > 0;)
+          body.insert(body.end(), buffer, buffer + n);
+        return true;
+      }
+      const size_t have = body.size();
+      body.resize(contentLength);
+      for (size_t done = have; done < body.size();) {
+        const ssize_t n = recv(fd, body.data() + done, body.size() - done, 0);
+        if (n <= 0)
+          return false;
+        done += n;
+      }
+      return true;
+    }
+
+    HttpBrickSource::State::Response
+    HttpBrickSource::State::send(const char *method, const std::string &name,
+                                 uint64_t begin, uint64_t end)
+    {
+      std::string req = std::string(method) + " " + path + "/" + name
+                        + " HTTP/1.1\r\n" "Host: " + host + "\r\n";
+      if (end > 0)
+        req += "Range: bytes=" + std::to_string(begin) + "-"
+               + std::to_string(end - 1) + "\r\n";
+      req += "\r\n";
+
+      // a kept-alive connection may have been closed by the server in
+      // the meantime; retry once on a fresh one
+      for (int attempt = 0; ; attempt++) {
+        const int fd = acquire();
+        Response response;
+        bool ok = false;
+        try {
+          ok = request(fd, req, strcmp(method, "HEAD") == 0, response);
+        } catch (...) {
+          release(fd, false);
+          throw;
+        }
+        release(fd, ok && response.keepAlive);
+        if (ok)
+          return response;
+        if (attempt > 0)
+          throw std::runtime_error("lost connection to brick source "
+                                   + host + " reading " + name);
+      }
+    }
+
+    std::vector<char> HttpBrickSource::State::get(const std::string &name,
+                                                  uint64_t begin,
+                                                  uint64_t end)
+    {
+      Response response = send("GET", name, begin, end);
+      std::vector<char> &body = response.body;
+      if (response.status == 206 || (response.status == 200 && end == 0))
+        return std::move(body);
+      if (response.status == 200) {
+        // the server ignored the range and sent the whole file; keep
+        // all of it so the next read does not fetch it again
+        cacheWhole(versionDir(name), body);
+        begin = std::min<uint64_t>(begin, body.size());
+        end   = std::min<uint64_t>(end, body.size());
+        return std::vector<char>(body.begin() + begin, body.begin() + end);
+      }
+      if (response.status == 416)
+        return std::vector<char>(); // range starts past the end
+      throw std::runtime_error("brick source " + host + " answered "
+                               + std::to_string(response.status)
+                               + " for " + name);
+    }
+
+    HttpBrickSource::State::FileInfo
+    HttpBrickSource::State::head(const std::string &name)
+    {
+      Response response = send("HEAD", name, 0, 0);
+      if (response.status != 200)
+        throw std::runtime_error("brick source " + host + " answered "
+                                 + std::to_string(response.status)
+                                 + " for " + name);
+      auto header = [&](const char *key) {
+        auto it = response.headers.find(key);
+        return it == response.headers.end() ? std::string() : it->second;
+      };
+      std::string tag = header("etag");
+      if (tag.empty())
+        tag = header("last-modified");
+      FileInfo fi;
+      fi.version = fileNameSafe(header("content-length") + "-" + tag);
+      std::string ranges = header("accept-ranges");
+      std::transform(ranges.begin(), ranges.end(), ranges.begin(), ::tolower);
+      fi.ranges = ranges == "bytes";
+      return fi;
+    }
+
+    HttpBrickSource::State::FileInfo
+    HttpBrickSource::State::fileInfo(const std::string &name)
+    {
+      std::promise<FileInfo> claimed;
+      std::shared_future<FileInfo> known;
+      {
+        std::lock_guard<std::mutex> lock(infoMtx);
+        auto it = info.find(name);
+        if (it != info.end())
+          return it->second.get();
+        known = info[name] = claimed.get_future().share();
+      }
+      try {
+        FileInfo fi = head(name);
+        const std::string dir = cacheDir + "/" + name + "." + fi.version;
+        makeDirs(dir);
+        // without byte ranges the file is fetched once, in one piece,
+        // before anyone reads from it
+        struct stat st;
+        if (!fi.ranges && stat(chunkFile(dir, 0).c_str(), &st) != 0)
+          cacheWhole(dir, get(name, 0, 0));
+        claimed.set_value(fi);
+      } catch (...) {
+        claimed.set_exception(std::current_exception());
+        // asked again by the next read
+        std::lock_guard<std::mutex> lock(infoMtx);
+        info.erase(name);
+        throw;
+      }
+      return known.get();
+    }
+
+    Chunk HttpBrickSource::State::readCache(const std::string &dir,
+                                            uint64_t chunk) const
+    {
+      std::ifstream in(chunkFile(dir, chunk), std::ios::binary);
+      if (!in)
+        return nullptr;
+      auto data = std::make_shared<std::vector<char>>(
+        (std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+      return data;
+    }
+
+    void HttpBrickSource::State::writeCache(const std::string &file,
+                                            const char *data,
+                                            size_t size) const
+    {
+      // readers only ever see complete files
+      std::ostringstream tmp;
+      tmp << file << ".tmp" << getpid() << "." << std::this_thread::get_id();
+      FILE *out = fopen(tmp.str().c_str(), "wb");
+      if (!out)
+        return; // a full or read-only cache only costs refetches
+      const bool ok = fwrite(data, 1, size, out) == size;
+      if (fclose(out) == 0 && ok)
+        rename(tmp.str().c_str(), file.c_str());
+      else
+        remove(tmp.str().c_str());
+    }
+
+    void HttpBrickSource::State::cacheWhole(const std::string &dir,
+                                            const std::vector<char> &body) const
+    {
+      for (uint64_t lo = 0, c = 0; lo < body.size() || c == 0;
+           lo += chunkSize, c++)
+        writeCache(chunkFile(dir, c), body.data() + lo,
+                   std::min<uint64_t>(body.size() - lo, uint64_t(chunkSize)));
+    }
+
+    std::string HttpBrickSource::localPath(const std::string &name)
+    {
+      const std::string file = state->versionDir(name) + "/" + name;
+      struct stat st;
+      if (stat(file.c_str(), &st) == 0)
+        return file;
+      const std::vector<char> body = state->get(name, 0, 0);
+      state->writeCache(file, body.data(), body.size());
+      if (stat(file.c_str(), &st) != 0)
+        throw std::runtime_error("could not cache " + name + " in "
+                                 + state->cacheDir);
+      return file;
+    }
+
+    //! a run of adjacent chunks fetched with one request
+    struct ChunkRun
+    {
+      std::string dir, name;
+      uint64_t first, last;
+      std::vector<std::promise<Chunk>> chunks;
+    };
+
+    void HttpBrickSource::read(const std::string &name,
+                               std::vector<Range> ranges)
+    {
+      std::vector<uint64_t> needed;
+      for (const Range &r : ranges)
+        for (uint64_t c = r.offset / chunkSize;
+             r.size > 0 && c <= (r.offset + r.size - 1) / chunkSize; c++)
+          needed.push_back(c);
+      std::sort(needed.begin(), needed.end());
+      needed.erase(std::unique(needed.begin(), needed.end()), needed.end());
+
+      // the file's current version names its cache directory
+      const std::string dir = state->versionDir(name);
+
+      // claim the chunks nobody is fetching yet
+      std::map<uint64_t, std::shared_future<Chunk>> chunks;
+      std::map<uint64_t, std::promise<Chunk>> claimed;
+      {
+        std::lock_guard<std::mutex> lock(state->flightMtx);
+        for (uint64_t c : needed) {
+          const std::string key = name + "#" + std::to_string(c);
+          auto it = state->inFlight.find(key);
+          if (it != state->inFlight.end()) {
+            chunks[c] = it->second;
+            continue;
+          }
+          std::promise<Chunk> &p = claimed[c];
+          chunks[c] = state->inFlight[key] = p.get_future().share();
+        }
+      }
+
+      // claimed chunks come from the disk cache or from runs of
+      // adjacent missing chunks, one request per run, handed to the
+      // fetch threads. a run owns its promises and drops its chunks
+      // from inFlight once they are set, whether or not this read
+      // still waits for them
+      std::vector<std::shared_ptr<ChunkRun>> runs;
+      std::vector<uint64_t> cachedChunks;
+      for (auto &p : claimed) {
+        const uint64_t c = p.first;
+        if (Chunk cached = state->readCache(dir, c)) {
+          p.second.set_value(cached);
+          cachedChunks.push_back(c);
+          continue;
+        }
+        if (runs.empty() || runs.back()->last != c
+            || c - runs.back()->first >= maxRunChunks) {
+          runs.push_back(std::make_shared<ChunkRun>());
+          runs.back()->dir   = dir;
+          runs.back()->name  = name;
+          runs.back()->first = c;
+          runs.back()->last  = c;
+        }
+        runs.back()->last++;
+        runs.back()->chunks.push_back(std::move(p.second));
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(state->flightMtx);
+        for (uint64_t c : cachedChunks)
+          state->inFlight.erase(name + "#" + std::to_string(c));
+      }
+
+      {
+        std::lock_guard<std::mutex> lock(state->jobMtx);
+        State *s = state.get();
+        for (auto &run : runs)
+          state->jobs.push_back([s, run] {
+            size_t numSet = 0;
+            try {
+              const std::vector<char> body = s->get(
+                run->name, run->first * chunkSize, run->last * chunkSize);
+              for (uint64_t c = run->first; c < run->last; c++) {
+                const size_t lo = std::min<size_t>((c - run->first) * chunkSize,
+                                                   body.size());
+                const size_t hi = std::min<size_t>(lo + chunkSize, body.size());
+                auto chunk = std::make_shared<std::vector<char>>(
+                  body.begin() + lo, body.begin() + hi);
+                s->writeCache(State::chunkFile(run->dir, c),
+                              chunk->data(), chunk->size());
+                run->chunks[numSet].set_value(chunk);
+                numSet++;
+              }
+            } catch (...) {
+              // only the chunks not delivered yet
+              for (; numSet < run->chunks.size(); numSet++)
+                run->chunks[numSet].set_exception(std::current_exception());
+            }
+            std::lock_guard<std::mutex> lock(s->flightMtx);
+            for (uint64_t c = run->first; c < run->last; c++)
+              s->inFlight.erase(run->name + "#" + std::to_string(c));
+          });
+      }
+      state->jobCond.notify_all();
+
+      for (const Range &r : ranges) {
+        char *dst = (char *)r.dst;
+        for (uint64_t done = 0; done < r.size;) {
+          const uint64_t pos = r.offset + done;
+          const Chunk chunk = chunks[pos / chunkSize].get();
+          const uint64_t inChunk = pos % chunkSize;
+          if (inChunk >= chunk->size())
+            throw std::runtime_error("short read from brick source: " + name
+                                     + " ends before byte "
+                                     + std::to_string(pos));
+          const uint64_t n = std::min<uint64_t>(r.size - done,
+                                                chunk->size() - inChunk);
+          memcpy(dst + done, chunk->data() + inChunk, n);
+          done += n;
+        }
+        bytesRead += r.size;
+      }
+    }
+
+  } // ::ospray::bt
+} // ::ospray
@@ -0,0 +1,125 @@
+// ======================================================================== //
+// Copyright 2009-2017 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+// std
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace ospray {
+namespace bt
+{
+
+/*! where a forest's files are read from. files are named relative to
+    the forest, e.g. "magnetic-bt-brick000012.ospbin"; the loaders only
+    ever read byte ranges of them, small files such as a tree's .osp
+    header are used through a local copy */
+class BrickSource
+{
+public:
+  /*! 'size' bytes at 'offset' of a file go to 'dst' */
+  struct Range
+  {
+    uint64_t offset;
+    uint64_t size;
+    void *dst;
+  };
+
+  virtual ~BrickSource() = default;
+
+  /*! read all 'ranges' of file 'name'; throws if any of them cannot be
+      read completely */
+  virtual void read(const std::string &name, std::vector<Range> ranges) = 0;
+
+  /*! path of a local copy of file 'name', empty if there is none */
+  virtual std::string localPath(const std::string &name) = 0;
+
+  /*! size and modification time of file 'name', to notice files that
+      changed since a manifest was written; false if the source cannot
+      tell without fetching the file */
+  virtual bool fileStamp(const std::string &name, uint64_t &bytes,
+                         int64_t &mtime)
+  { return false; }
+
+  /*! "<forest>-brick<treeID>.<ext>" */
+  std::string treeFile(size_t treeID, const char *ext) const;
+
+  /*! open a forest's files next to 'brickFileBase' (its path without
+      extension), or, if 'url' is given, the files of that name under an
+      http url, e.g. an S3-compatible bucket. remote reads are cached in
+      'cacheDir' */
+  static std::shared_ptr<BrickSource> open(const std::string &brickFileBase,
+                                           const std::string &url = "",
+                                           const std::string &cacheDir = "",
+                                           int numConnections = 16);
+
+  /*! bytes delivered by read() so far, for benchmarks */
+  std::atomic<uint64_t> bytesRead{0};
+
+protected:
+  //! file name of the forest without path and extension
+  std::string baseName;
+};
+
+/*! the forest's files on a local file system */
+class FileBrickSource : public BrickSource
+{
+public:
+  explicit FileBrickSource(const std::string &brickFileBase);
+
+  void read(const std::string &name, std::vector<Range> ranges) override;
+  std::string localPath(const std::string &name) override;
+  bool fileStamp(const std::string &name, uint64_t &bytes,
+                 int64_t &mtime) override;
+
+private:
+  std::string dir;
+};
+
+/*! the forest's files behind a web server or object store that honors
+    http range requests. reads are split into aligned chunks: chunks in
+    the disk cache are read from there, missing ones are fetched with
+    one range request per run of adjacent chunks, several requests in
+    flight at once over keep-alive connections. a chunk another thread
+    is already fetching is waited for instead of being fetched again.
+    cached chunks are kept per file version (size and ETag or
+    Last-Modified, from one HEAD request per file), and a file whose
+    server does not take byte ranges is fetched whole, once */
+class HttpBrickSource : public BrickSource
+{
+public:
+  static const uint64_t chunkSize = uint64_t(256) << 10;
+  //! longest run of chunks fetched with one request
+  static const uint64_t maxRunChunks = 16;
+
+  HttpBrickSource(const std::string &brickFileBase, const std::string &url,
+                  const std::string &cacheDir, int numConnections);
+  ~HttpBrickSource() override;
+
+  void read(const std::string &name, std::vector<Range> ranges) override;
+  std::string localPath(const std::string &name) override;
+
+private:
+  struct State;
+  std::unique_ptr<State> state;
+};
+
+}  // namespace bt
+}  // namespace ospray
@@ -30,6 +30,7 @@
 #include <fcntl.h>
 #include <string>
 #include <cstring>
+#include <algorithm>
 
 // O_LARGEFILE is a GNU extension.
 #ifdef __APPLE__
@@ -67,24 +68,7 @@ namespace ospray {
     template <int N, typename T>
     BrickTree<N, T>::~BrickTree()
     {
-      if (!valueBrick)
-        free(valueBrick);
-      if (!indexBrick)
-        free(indexBrick);
-      if (!brickInfo)
-        free(brickInfo);
-      if (!valueBricksStatus)
-        free(valueBricksStatus);
-      if(!vbIdxByLevelStride)
-        free(vbIdxByLevelStride);
-      
-      for(int i = 0 ; i < depth ; i++){
-        if(!vbIdxByLevelBuffers[i])
-          free(vbIdxByLevelBuffers[i]);
-      }
-
-      if(!vbIdxByLevelBuffers)
-        free(vbIdxByLevelBuffers);
+      // all brick memory is owned by the forest's arena
     }
 
     template <int N, typename T>
@@ -106,18 +90,17 @@ namespace ospray {
     /*! map this one from a binary dump that was created by the
      * bricktreebuilder/raw2bricks tool */
     template <int N, typename T>
-    void BrickTree<N, T>::mapOSP(const FileName &brickFileBase,
+    void BrickTree<N, T>::mapOSP(BrickSource &source,
                                  int blockID,
                                  vec3i treeCoord)
     {
-      char blockFileName[10000];
-      sprintf(blockFileName,"%s-brick%06i.osp",
-              brickFileBase.str().c_str(),(int)blockID);
+      const std::string blockFileName =
+        source.localPath(source.treeFile(blockID, "osp"));
 
       std::shared_ptr<xml::XMLDoc> doc = xml::readXML(blockFileName);
       if (!doc)
         throw std::runtime_error("could not read brick tree .osp file '" +
-                                 std::string(blockFileName) + "'");
+                                 blockFileName + "'");
       std::shared_ptr<xml::Node> osprayNode = std::make_shared<xml::Node>(doc->child[0]);
       assert(osprayNode->name == "ospray");
 
@@ -146,162 +129,90 @@ namespace ospray {
 
       numBrickInfos   = std::stoll(indexBrickOfNode->getProp("num"));
       indexBrickOfOfs = std::stoll(indexBrickOfNode->getProp("ofs"));
-
-      valueBrick = (ValueBrick *)malloc(sizeof(ValueBrick) * numValueBricks);
-      indexBrick = (IndexBrick *)malloc(sizeof(IndexBrick) * numIndexBricks);
-      brickInfo  = (BrickInfo *)malloc(sizeof(BrickInfo) * numBrickInfos);
-
-      valueBricksStatus = (BrickStatus*)malloc(sizeof(BrickStatus)*numValueBricks);
-
-      sprintf(blockFileName,"%s-brick%06i.ospbin",brickFileBase.str().c_str(),(int)blockID);
-
-      FILE *file = fopen(blockFileName, "rb");
-      if (!file)
-        throw std::runtime_error("could not open brick bin file " + std::string(blockFileName));
-      fseek(file, indexBricksOfs, SEEK_SET);
-      fread(indexBrick, sizeof(IndexBrick), numIndexBricks, file);
-      fseek(file, indexBrickOfOfs, SEEK_SET);
-      fread(brickInfo, sizeof(BrickInfo), numBrickInfos, file);
-
-      fclose(file);
-
-      //reorganize the valuebrick buffer by bricktree level
-      vbIdxByLevelBuffers = (size_t**)malloc(sizeof(size_t*) * depth);
-      vbIdxByLevelStride = (size_t*)malloc(sizeof(size_t) * depth);
-
     }
 
+    /*! read the index bricks and brick infos; the tree's slices of the
+        forest arena have to be assigned */
     template <int N, typename T>
-    void BrickTree<N, T>::mapOspBin(const FileName &brickFileBase,
-                                    size_t blockID)
+    void BrickTree<N, T>::mapIndex(BrickSource &source, int blockID)
     {
-      // mmap the binary file
-      char blockFileName[10000];
-      sprintf(blockFileName,
-              "%s-brick%06i.ospbin",
-              brickFileBase.str().c_str(),
-              (int)blockID);
-
-      FILE *file = fopen(blockFileName, "rb");
-      if (!file)
-        throw std::runtime_error("could not open brick bin file " +
-                                 std::string(blockFileName));
-
-      fseek(file, indexBricksOfs, SEEK_SET);
-
-      fread(indexBrick, sizeof(IndexBrick), numIndexBricks, file);
-      fseek(file, valueBricksOfs, SEEK_SET);
-
-      fread(valueBrick, sizeof(ValueBrick), numValueBricks, file);
-      fseek(file, indexBrickOfOfs, SEEK_SET); 
+      source.read(source.treeFile(blockID, "ospbin"),
+                  {{indexBricksOfs, numIndexBricks * sizeof(IndexBrick),
+                    indexBrick},
+                   {indexBrickOfOfs, numBrickInfos * sizeof(BrickInfo),
+                    brickInfo}});
+    }
 
-      fread(brickInfo, sizeof(BrickInfo), numBrickInfos, file);
-      fclose(file);
+    template <int N, typename T>
+    void BrickTree<N, T>::mapOspBin(BrickSource &source, size_t blockID)
+    {
+      source.read(source.treeFile(blockID, "ospbin"),
+                  {{indexBricksOfs, numIndexBricks * sizeof(IndexBrick),
+                    indexBrick},
+                   {valueBricksOfs, numValueBricks * sizeof(ValueBrick),
+                    valueBrick},
+                   {indexBrickOfOfs, numBrickInfos * sizeof(BrickInfo),
+                    brickInfo}});
 
       for(size_t i = 0; i< numValueBricks;i++){
-        valueBricksStatus[i].isLoaded = true;
+        markLoaded(i);
       }
     }
 
     template <int N, typename T>
-    void BrickTree<N, T>::loadTreeByBrick(const FileName &brickFileBase,
+    void BrickTree<N, T>::loadTreeByBrick(BrickSource &source,
                                           size_t blockID,
                                           std::vector<int> vbReqList)
     {
-      char blockFileName[10000];
-      sprintf(blockFileName,
-              "%s-brick%06i.ospbin",
-              brickFileBase.str().c_str(),
-              (int)blockID);
-
-      FILE *file = fopen(blockFileName, "rb");
-      if (!file)
-        throw std::runtime_error("could not open brick bin file " +
-                                 std::string(blockFileName));
-
-      std::vector<int>::iterator it = vbReqList.begin();
-      for (; it != vbReqList.end(); it++) {
-        LoadBricks aBrick(VALUEBRICK, *it);
-        loadBricks(file, aBrick);
-        // printf("treeID:%d, vbid: %d, vbSize:%ld \n",
-        //     blockID,
-        //     *it,
-        //     numValueBricks);
+      // runs of consecutive bricks are read as one range
+      std::sort(vbReqList.begin(), vbReqList.end());
+      std::vector<vec2i> runs;
+      for (int vbID : vbReqList) {
+        if (!runs.empty() && runs.back().x + runs.back().y == vbID)
+          runs.back().y++;
+        else if (runs.empty() || runs.back().x + runs.back().y < vbID)
+          runs.emplace_back(vbID, 1);
       }
-      fclose(file);
+      loadBricks(source, blockID, runs);
     }
 
     template <int N, typename T>
-    void BrickTree<N, T>::loadTreeByBrick(const FileName &brickFileBase,
+    void BrickTree<N, T>::loadTreeByBrick(BrickSource &source,
                                           size_t blockID,
                                           std::vector<vec2i> vbReqList)
     {
-      char blockFileName[10000];
-      sprintf(blockFileName,"%s-brick%06i.ospbin",
-              brickFileBase.str().c_str(),(int)blockID);
-
-      FILE *file = fopen(blockFileName, "rb");
-      if (!file)
-        throw std::runtime_error("could not open brick bin file " +
-                                 std::string(blockFileName));
-
-      std::vector<vec2i>::iterator it = vbReqList.begin();
-      for (; it != vbReqList.end(); it++) {
-        loadBricks(file, *it);
-      }
-      fclose(file);
+      loadBricks(source, blockID, vbReqList);
     }
 
     template <int N, typename T>
-    void BrickTree<N, T>::loadTreeByBrick(const FileName &brickFileBase,
+    void BrickTree<N, T>::loadTreeByBrick(BrickSource &source,
                                           size_t treeID)
     {
-      char blockFileName[10000];
-      sprintf(blockFileName,"%s-brick%06i.ospbin",
-              brickFileBase.str().c_str(),(int)treeID);
-      FILE *file = fopen(blockFileName, "rb");
-      if (!file)
-        throw std::runtime_error("could not open brick bin file " +
-                                 std::string(blockFileName));
-      for (size_t i = 0; i < numValueBricks; i++) {       
-        if (!valueBricksStatus[i].isLoaded &&
-            valueBricksStatus[i].isRequested) {
-          LoadBricks aBrick(VALUEBRICK, i);
-          loadBricks(file, aBrick);
-        }
-      }
-      fclose(file);
-    }
-
-    template <int N, typename T>
-    void BrickTree<N, T>::loadBricks(FILE *file, vec2i vbListInfo)
-    {
-      fseek(file, valueBricksOfs + vbListInfo.x * sizeof(ValueBrick), 
-            SEEK_SET);
-      fread((ValueBrick *)(valueBrick + vbListInfo.x),
-            sizeof(ValueBrick), vbListInfo.y, file);
-      for (int i = 0; i < vbListInfo.y; i++) {
-        valueBricksStatus[vbListInfo.x + i].isLoaded = true;
-	// Untested ...
-        //auto rg = std::minmax_element((T*)(valueBrick+vbListInfo.x+i),
-        //                              (T*)(valueBrick+vbListInfo.x+i+1));
-        //valueBricksStatus[vbListInfo.x + i].valueRange.x = *(rg.first);
-        //valueBricksStatus[vbListInfo.x + i].valueRange.y = *(rg.second);
+      std::vector<int> vbReqList;
+      for (size_t i = 0; i < numValueBricks; i++) {
+        if (needsLoad(i))
+          vbReqList.push_back(i);
       }
+      loadTreeByBrick(source, treeID, vbReqList);
     }
 
     template <int N, typename T>
-    void BrickTree<N, T>::loadBricks(FILE *file, LoadBricks aBrick)
+    void BrickTree<N, T>::loadBricks(BrickSource &source, size_t treeID,
+                                     const std::vector<vec2i> &vbListInfo)
     {
-      fseek(file, valueBricksOfs + aBrick.brickID * sizeof(ValueBrick), 
-            SEEK_SET);
-      fread((ValueBrick *)(valueBrick + aBrick.brickID),
-	    sizeof(ValueBrick), 1, file);
-      valueBricksStatus[aBrick.brickID].isLoaded = true;
-      //auto rg = std::minmax_element((T*)(valueBrick + aBrick.brickID),
-      //	  		      (T*)(valueBrick + aBrick.brickID + 1));
-      //valueBricksStatus[aBrick.brickID].valueRange.x = *(rg.first);
-      //valueBricksStatus[aBrick.brickID].valueRange.y = *(rg.second);
+      if (vbListInfo.empty())
+        return;
+      std::vector<BrickSource::Range> ranges;
+      ranges.reserve(vbListInfo.size());
+      for (const vec2i &run : vbListInfo)
+        ranges.push_back({valueBricksOfs + run.x * sizeof(ValueBrick),
+                          run.y * sizeof(ValueBrick),
+                          (ValueBrick *)(valueBrick + run.x)});
+      source.read(source.treeFile(treeID, "ospbin"), ranges);
+      // publish only once the data is in place
+      for (const vec2i &run : vbListInfo)
+        for (int i = 0; i < run.y; i++)
+          markLoaded(run.x + i);
     }
 
     template <int N, typename T>
@@ -315,22 +226,19 @@ namespace ospray {
 
 #if STREAM_DATA
 
-      if(valueBricksStatus[cBrickID].isLoaded){
+      if(isLoaded(cBrickID)){
         // current brick is loaded 
         vb = (typename BrickTree<N, T>::ValueBrick *)(valueBrick + cBrickID);
         return vb->value[cPos.z][cPos.y][cPos.x];
-      } else if (valueBricksStatus[cBrickID].isRequested != 0 ){
+      } else if (request(cBrickID)){
         // current brick has been requested but not yet loaded
         // return the loaded parent brick or return the average value
-        if(valueBricksStatus[pBrickID].isLoaded != 0){
+        if(pBrickID != size_t(invalidID()) && isLoaded(pBrickID)){
           vb = (typename BrickTree<N, T>::ValueBrick *)(valueBrick + pBrickID);
           return vb->value[pPos.z][pPos.y][pPos.x];
         } else{
           return this->avgValue;
         }
-      } else{
-        // request current brick if it is not requested
-        valueBricksStatus[cBrickID].isRequested = 1;
       }
 
       return this->avgValue;
@@ -345,26 +253,33 @@ namespace ospray {
 
     template <int N, typename T>
     const T BrickTree<N, T>::findValue(const int blockID, const vec3i &coord,
-                                       int blockWidth)
+                                       const BrickLevelTable &levels)
     {
       // return 0.2f;
+#if STREAM_DATA
+      // an unopened tree samples as its average; requesting the root
+      // asks the loader to open it
+      if (!opened()) {
+        request(0);
+        return this->avgValue;
+      }
+#endif
       // start with the root brick
-      int brickSize = blockWidth;
-      assert(reduce_max(coord) < brickSize);
+      assert(levels.log2N == log2PowerOf2(N));
       int32_t brickID       = 0;
       int32_t parentBrickID = BrickTree<N, T>::invalidID();
       vec3i cpos(0);
       vec3i parentCellPos(0);
-      while (brickSize > N) {
-        int cellSize = brickSize / N;
-
-        cpos.x = (coord.x % brickSize) / cellSize;
-        cpos.y = (coord.y % brickSize) / cellSize;
-        cpos.z = (coord.z % brickSize) / cellSize;
+      int level = 0;
+      while (levels.shift[level] > levels.log2N) {
+        cpos = levels.cellPos(coord, level);
 
-        parentCellPos.x = (coord.x % (brickSize * N)) / brickSize;
-        parentCellPos.y = (coord.y % (brickSize * N)) / brickSize;
-        parentCellPos.z = (coord.z % (brickSize * N)) / brickSize;
+        // position in the parent brick, one level up
+        const int pMask  = (1 << (levels.shift[level] + levels.log2N)) - 1;
+        const int pShift = levels.shift[level];
+        parentCellPos.x = (coord.x & pMask) >> pShift;
+        parentCellPos.y = (coord.y & pMask) >> pShift;
+        parentCellPos.z = (coord.z & pMask) >> pShift;
 
         int32_t ibID = brickInfo[brickID].indexBrickID;
         if (ibID == BrickTree<N, T>::invalidID()) {
@@ -381,15 +296,149 @@ namespace ospray {
             brickID       = childBrickID;
           }
         }
-        brickSize = cellSize;
+        level++;
       }
 
-      cpos.x = coord.x % brickSize;
-      cpos.y = coord.y % brickSize;
-      cpos.z = coord.z % brickSize;
+      cpos.x = coord.x & (N - 1);
+      cpos.y = coord.y & (N - 1);
+      cpos.z = coord.z & (N - 1);
       return findBrickValue(blockID, brickID, cpos, parentBrickID, parentCellPos);
     }
 
+    template <int N, typename T>
+    void BrickTree<N, T>::findValues(const int blockID,
+                                     const vec3i *coords,
+                                     int cornerMask,
+                                     const BrickLevelTable &levels,
+                                     T *values,
+                                     int maxLevel)
+    {
+#if STREAM_DATA
+      if (!opened()) {
+        request(0);
+        for (int i = 0; i < 8; i++)
+          if ((cornerMask >> i) & 1)
+            values[i] = this->avgValue;
+        return;
+      }
+#endif
+      findValuesRec(blockID, 0, BrickTree<N, T>::invalidID(), 0,
+                    coords, cornerMask, levels, values, maxLevel);
+    }
+
+    template <int N, typename T>
+    void BrickTree<N, T>::findValuesRec(const int blockID,
+                                        int32_t brickID,
+                                        int32_t parentBrickID,
+                                        int level,
+                                        const vec3i *coords,
+                                        int cornerMask,
+                                        const BrickLevelTable &levels,
+                                        T *values,
+                                        int maxLevel)
+    {
+      // on the finest level cells are voxels and cellPos() is c % N
+      const bool refine = levels.shift[level] > levels.log2N
+                          && level < maxLevel;
+      const int32_t ibID = brickInfo[brickID].indexBrickID;
+      const int pMask  = (1 << (levels.shift[level] + levels.log2N)) - 1;
+      const int pShift = levels.shift[level];
+
+      while (cornerMask) {
+        // group the remaining corners falling into the first one's cell
+        const int first = __builtin_ctz(cornerMask);
+        const vec3i cpos = levels.cellPos(coords[first], level);
+        int group = 0;
+        for (int i = first; i < 8; i++)
+          if (((cornerMask >> i) & 1)
+              && levels.cellPos(coords[i], level) == cpos)
+            group |= 1 << i;
+        cornerMask &= ~group;
+
+        int32_t childBrickID = BrickTree<N, T>::invalidID();
+        if (refine && ibID != BrickTree<N, T>::invalidID())
+          childBrickID = indexBrick[ibID].childID[cpos.z][cpos.y][cpos.x];
+
+        if (childBrickID != BrickTree<N, T>::invalidID()) {
+          findValuesRec(blockID, childBrickID, brickID, level + 1,
+                        coords, group, levels, values, maxLevel);
+          continue;
+        }
+
+        const vec3i ppos((coords[first].x & pMask) >> pShift,
+                         (coords[first].y & pMask) >> pShift,
+                         (coords[first].z & pMask) >> pShift);
+        const T value = findBrickValue(blockID, brickID, cpos,
+                                       parentBrickID, ppos);
+        for (int i = first; i < 8; i++)
+          if ((group >> i) & 1)
+            values[i] = value;
+      }
+    }
+
+    template <int N, typename T>
+    void BrickTree<N, T>::findSortedValues(const int blockID,
+                                           const vec3i *coords,
+                                           size_t count,
+                                           const BrickLevelTable &levels,
+                                           T *values,
+                                           int maxLevel)
+    {
+#if STREAM_DATA
+      if (!opened()) {
+        request(0);
+        std::fill(values, values + count, this->avgValue);
+        return;
+      }
+#endif
+      findSortedValuesRec(blockID, 0, BrickTree<N, T>::invalidID(), 0,
+                          coords, count, levels, values, maxLevel);
+    }
+
+    template <int N, typename T>
+    void BrickTree<N, T>::findSortedValuesRec(const int blockID,
+                                              int32_t brickID,
+                                              int32_t parentBrickID,
+                                              int level,
+                                              const vec3i *coords,
+                                              size_t count,
+                                              const BrickLevelTable &levels,
+                                              T *values,
+                                              int maxLevel)
+    {
+      const bool refine = levels.shift[level] > levels.log2N
+                          && level < maxLevel;
+      const int32_t ibID = brickInfo[brickID].indexBrickID;
+      const int pMask  = (1 << (levels.shift[level] + levels.log2N)) - 1;
+      const int pShift = levels.shift[level];
+
+      for (size_t begin = 0, end; begin < count; begin = end) {
+        // cells are aligned power of two cubes, so in morton order the
+        // coordinates falling into one are contiguous
+        const vec3i cpos = levels.cellPos(coords[begin], level);
+        for (end = begin + 1;
+             end < count && levels.cellPos(coords[end], level) == cpos; end++)
+          ;
+
+        int32_t childBrickID = BrickTree<N, T>::invalidID();
+        if (refine && ibID != BrickTree<N, T>::invalidID())
+          childBrickID = indexBrick[ibID].childID[cpos.z][cpos.y][cpos.x];
+
+        if (childBrickID != BrickTree<N, T>::invalidID()) {
+          findSortedValuesRec(blockID, childBrickID, brickID, level + 1,
+                              coords + begin, end - begin, levels,
+                              values + begin, maxLevel);
+          continue;
+        }
+
+        const vec3i ppos((coords[begin].x & pMask) >> pShift,
+                         (coords[begin].y & pMask) >> pShift,
+                         (coords[begin].z & pMask) >> pShift);
+        std::fill(values + begin, values + end,
+                  findBrickValue(blockID, brickID, cpos, parentBrickID, ppos));
+      }
+    }
+
     template <int N, typename T>
     double BrickTree<N, T>::ValueBrick::computeWeightedAverage( // coordinates of lower-left-front
                                                                 // voxel, in resp level
@@ -19,9 +19,15 @@
 // common
 #include "common/config.h"
 #include "common/helper.h"
+// bricktree
+#include "BrickArena.h"
+#include "BrickSource.h"
+#include "BrickServer.h"
+#include "TreePartition.h"
 // ospray
 #include "ospcommon/array3D/Array3D.h"
 #include "ospcommon/box.h"
+#include "ospcommon/malloc.h"
 // ospcommon
 #include "ospcommon/FileName.h"
 #if __clang__
@@ -49,7 +55,14 @@
 #include <thread>
 #include <algorithm>
 #include <unordered_map>
+#include <atomic>
+#include <memory>
+#include <chrono>
+#include <cstring>
 #include <math.h>
+#include <signal.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <common/helper.h>
 
 namespace ospray {
@@ -84,29 +97,370 @@ struct LoadBricks
   size_t brickID;  // N th of a specific brick
 };
 
-struct BrickStatus
+/*! per-brick residency state is kept as one bit per value brick in
+    separate bitsets (requested, loaded), each in its own cache
+    line aligned allocation, so renderer lanes setting request bits do
+    not invalidate the lines the loader publishes loaded bits on. the
+    words are shared with ispc and accessed atomically on both sides */
+inline size_t brickBitsWords(size_t numBricks)
 {
-  BrickStatus()
-    :
-    isRequested(0),
-    isLoaded(0),
-    loadWeight(0.0)//,
-    // valueRange(vec2f(std::numeric_limits<float>::infinity(),
-    // 		     -std::numeric_limits<float>::infinity()))
+  // round up to whole cache lines
+  return ((numBricks + 511) / 512) * 8;
+}
+
+inline bool testBrickBit(const uint64_t *bits, size_t brickID)
+{
+  return (__atomic_load_n(bits + (brickID >> 6), __ATOMIC_ACQUIRE)
+          >> (brickID & 63)) & 1;
+}
+
+/*! set the bit, returns whether it was set before. the word is read
+    first so repeated requests don't dirty the cache line */
+inline bool testAndSetBrickBit(uint64_t *bits, size_t brickID)
+{
+  const uint64_t mask = uint64_t(1) << (brickID & 63);
+  uint64_t *word = bits + (brickID >> 6);
+  if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask)
+    return true;
+  return __atomic_fetch_or(word, mask, __ATOMIC_ACQ_REL) & mask;
+}
+
+inline bool isPowerOf2(int v)
+{
+  return v > 0 && (v & (v - 1)) == 0;
+}
+
+inline int log2PowerOf2(int v)
+{
+  int l = 0;
+  while ((1 << l) < v)
+    l++;
+  return l;
+}
+
+inline vec3i shiftLeft(const vec3i &v, int s)
+{
+  return vec3i(v.x << s, v.y << s, v.z << s);
+}
+
+inline vec3i shiftRight(const vec3i &v, int s)
+{
+  return vec3i(v.x >> s, v.y >> s, v.z >> s);
+}
+
+/*! whether the half-open boxes a and b overlap */
+inline bool overlaps(const box3i &a, const box3i &b)
+{
+  return a.lower.x < b.upper.x && b.lower.x < a.upper.x &&
+         a.lower.y < b.upper.y && b.lower.y < a.upper.y &&
+         a.lower.z < b.upper.z && b.lower.z < a.upper.z;
+}
+
+/*! shift/mask table for decomposing tree coordinates. a tree is
+    blockWidth = N^depth voxels wide and both are powers of two, so a
+    brick on level l spans (1 << shift[l]) voxels and the cell of 'c'
+    in it is (c & mask(l)) >> shift[l+1] - no integer divisions on the
+    sampling paths */
+struct BrickLevelTable
+{
+  static const int maxLevels = 32;
+
+  BrickLevelTable() = default;
+
+  BrickLevelTable(int N, int blockWidth)
   {
+    if (!isPowerOf2(N) || N < 2 || !isPowerOf2(blockWidth) || blockWidth < N)
+      throw std::runtime_error("BrickTree: brick size " + std::to_string(N)
+                               + " and block width "
+                               + std::to_string(blockWidth)
+                               + " have to be powers of two");
+    log2N      = log2PowerOf2(N);
+    blockShift = log2PowerOf2(blockWidth);
+    depth      = blockShift / log2N;
+    if (depth * log2N != blockShift || depth > maxLevels)
+      throw std::runtime_error("BrickTree: block width "
+                               + std::to_string(blockWidth)
+                               + " is not a power of brick size "
+                               + std::to_string(N));
+    for (int l = 0; l <= depth; l++)
+      shift[l] = blockShift - l * log2N;
   }
-  BrickStatus(int request, int load, float Weight/*, vec2f range*/)
-    :
-    isRequested(request),
-    isLoaded(load),
-    loadWeight(Weight)//,
-    //valueRange(range)
+
+  int mask(int level) const
+  { return (1 << shift[level]) - 1; }
+
+  //! cell of 'c' in its level-'level' brick, (c % brickW) / cellW
+  vec3i cellPos(const vec3i &c, int level) const
+  {
+    const int m = mask(level), s = shift[level + 1];
+    return vec3i((c.x & m) >> s, (c.y & m) >> s, (c.z & m) >> s);
+  }
+
+  //! tree the voxel 'c' lies in, per axis
+  vec3i treePos(const vec3i &c) const
+  {
+    return shiftRight(c, blockShift);
+  }
+
+  /*! sort key of voxel 'c' in tree 'tree': the tree in the high bits,
+      the morton code of its finest brick in the low 36. trees wider
+      than 4096 finest bricks drop the low bits of the brick position,
+      so neighbouring bricks share a key instead of spilling into the
+      tree bits */
+  uint64_t sortKey(uint64_t tree, const vec3i &c) const
   {
+    const int excess = std::max(0, blockShift - log2N - 12);
+    const int m = mask(0), s = log2N + excess;
+    return (tree << 36) | mortonCode3((c.x & m) >> s,
+                                      (c.y & m) >> s,
+                                      (c.z & m) >> s);
+  }
+
+  int log2N      = 0;
+  int blockShift = 0;
+  int depth      = 0;
+  int shift[maxLevels + 1] = {};
+};
+
+/*! a predicted camera view, used to prefetch the bricks that view
+    will need before the renderer asks for them */
+struct PrefetchView
+{
+  vec3f pos;
+  vec3f dir;
+  float fovy;   // vertical field of view, in degrees
+  float aspect;
+};
+
+/*! streaming totals of a forest, sampled by benchmarks once per frame */
+struct BrickCounts
+{
+  size_t requested = 0;
+  size_t loaded    = 0;
+  size_t bytesRead = 0;
+};
+
+/*! what a forest needs to know about a tree before opening it; one
+    entry per tree in the forest's manifest file */
+struct BrickTreeManifestEntry
+{
+  uint64_t numValueBricks;
+  uint64_t numIndexBricks;
+  uint64_t numBrickInfos;
+  uint64_t indexBricksOfs;
+  uint64_t valueBricksOfs;
+  uint64_t indexBrickOfOfs;
+  float avgValue;
+  int32_t nBrickSize;
+  float valueRange[2];
+  int32_t validSize[3];
+  int32_t depth;
+  /*! size and modification time of the tree's .ospbin when the entry
+      was made (0 if unknown); a manifest whose trees were rebuilt since
+      is ignored */
+  uint64_t binBytes;
+  int64_t binMTime;
+};
+
+/*! record the stamp of a tree's freshly written .ospbin in its entry */
+inline void stampManifestEntry(BrickTreeManifestEntry &e,
+                               const std::string &binFileName)
+{
+  struct stat st;
+  const bool known = stat(binFileName.c_str(), &st) == 0;
+  e.binBytes = known ? st.st_size : 0;
+  e.binMTime = known ? st.st_mtime : 0;
+}
+
+/*! whether the .ospbin file of 'e', of 'bytes' bytes last modified at
+    'mtime', is still the one the entry was made for: same stamp (if the
+    entry has one), and large enough for the entry's arrays */
+inline bool manifestEntryMatches(const BrickTreeManifestEntry &e,
+                                 int brickSize, int voxelBytes,
+                                 uint64_t bytes, int64_t mtime)
+{
+  if (e.binBytes != 0 && (e.binBytes != bytes || e.binMTime != mtime))
+    return false;
+  const uint64_t cells = uint64_t(brickSize) * brickSize * brickSize;
+  // a value brick also stores its value range
+  const uint64_t valueBrickBytes = (cells + 2) * voxelBytes;
+  return e.indexBricksOfs + e.numIndexBricks * cells * sizeof(int32_t) <= bytes
+    && e.valueBricksOfs + e.numValueBricks * valueBrickBytes <= bytes
+    && e.indexBrickOfOfs + e.numBrickInfos * sizeof(int32_t) <= bytes;
+}
+
+/*! leads a forest's manifest file; a manifest is only used if its
+    header matches the forest exactly */
+struct BrickTreeManifestHeader
+{
+  char magic[8];
+  uint32_t numTrees;
+  int32_t brickSize;
+  uint32_t voxelBytes;
+  uint32_t entryBytes;
+
+  static BrickTreeManifestHeader make(uint32_t numTrees, int32_t brickSize,
+                                      uint32_t voxelBytes)
+  {
+    BrickTreeManifestHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "BTMANIF", 8);
+    h.numTrees   = numTrees;
+    h.brickSize  = brickSize;
+    h.voxelBytes = voxelBytes;
+    h.entryBytes = sizeof(BrickTreeManifestEntry);
+    return h;
+  }
+};
+
+inline std::string manifestFileName(const FileName &brickFileBase)
+{
+  return brickFileBase.str() + ".manifest";
+}
+
+/*! read every entry of a manifest file; false if it is missing or was
+    written for a different forest */
+inline bool readManifestFile(const std::string &fileName,
+                             const BrickTreeManifestHeader &expected,
+                             std::vector<BrickTreeManifestEntry> &entries)
+{
+  FILE *file = fopen(fileName.c_str(), "rb");
+  if (!file)
+    return false;
+  entries.resize(expected.numTrees);
+  BrickTreeManifestHeader header;
+  const bool valid =
+    fread(&header, sizeof(header), 1, file) == 1 &&
+    memcmp(&header, &expected, sizeof(header)) == 0 &&
+    fread(entries.data(), sizeof(BrickTreeManifestEntry), entries.size(), file)
+      == entries.size();
+  fclose(file);
+  return valid;
+}
+
+/*! write a manifest file. several processes (e.g. every rank) may write
+    the same one, so it is written under a name of its own and renamed
+    over 'fileName' once complete: readers see the old or the new file,
+    never a mix. throws if the file could not be written */
+inline void writeManifestFile(const std::string &fileName,
+                              const BrickTreeManifestHeader &header,
+                              const std::vector<BrickTreeManifestEntry> &entries)
+{
+  const std::string tmpName =
+    fileName + ".tmp" + std::to_string(getpid());
+  FILE *file = fopen(tmpName.c_str(), "wb");
+  if (!file)
+    throw std::runtime_error("could not write manifest " + fileName);
+  const bool ok =
+    fwrite(&header, sizeof(header), 1, file) == 1
+    && fwrite(entries.data(), sizeof(BrickTreeManifestEntry), entries.size(),
+              file) == entries.size();
+  if (fclose(file) != 0 || !ok || rename(tmpName.c_str(), fileName.c_str()) != 0) {
+    remove(tmpName.c_str());
+    throw std::runtime_error("could not write manifest " + fileName);
+  }
+}
+
+/*! bytes a tree's bricks take in memory, which is also what the loader
+    has to read to bring the whole tree in */
+inline double manifestTreeBytes(const BrickTreeManifestEntry &e,
+                                int brickSize, int voxelBytes)
+{
+  const double cells = double(brickSize) * brickSize * brickSize;
+  // a value brick also stores its value range
+  return e.numValueBricks * (cells + 2) * voxelBytes
+         + e.numIndexBricks * cells * sizeof(int32_t)
+         + e.numBrickInfos * sizeof(int32_t);
+}
+
+/*! how a forest's trees are split between 'numRanks' ranks. a partition
+    file (as written by ospBrickPartition) is used as is; otherwise the
+    trees are balanced by the bytes the manifest lists for them, or by
+    their count if there is no manifest yet. deterministic, so every
+    rank (and the application) arrives at the same split */
+inline TreePartition forestPartition(const FileName &brickFileBase,
+                                     const vec3i &gridSize,
+                                     int brickSize,
+                                     int voxelBytes,
+                                     int numRanks,
+                                     const std::string &partitionFile = "")
+{
+  if (!partitionFile.empty()) {
+    TreePartition p = TreePartition::load(partitionFile);
+    if (!(p.gridSize == gridSize) || p.numRanks() != numRanks)
+      throw std::runtime_error("partition file " + partitionFile
+                               + " does not match this forest and "
+                               + std::to_string(numRanks) + " ranks");
+    return p;
+  }
+  const int numTrees = gridSize.product();
+  std::vector<BrickTreeManifestEntry> entries;
+  if (numRanks < 2
+      || !readManifestFile(manifestFileName(brickFileBase),
+                           BrickTreeManifestHeader::make(numTrees, brickSize,
+                                                         voxelBytes),
+                           entries))
+    return TreePartition::kdSplit(gridSize, numRanks);
+  std::vector<double> cost(numTrees);
+  for (int i = 0; i < numTrees; i++)
+    cost[i] = manifestTreeBytes(entries[i], brickSize, voxelBytes);
+  return TreePartition::kdSplit(gridSize, numRanks, cost);
+}
+
+/*! summary statistics of a box of a forest, see regionStats() */
+struct RegionStats
+{
+  float minValue = std::numeric_limits<float>::infinity();
+  float maxValue = -std::numeric_limits<float>::infinity();
+  double mean    = 0.;
+  //! voxels covered by the box (inside the volume)
+  size_t numVoxels = 0;
+  //! voxel counts of numBins equal bins over histogramRange; values
+  //! outside the range count into the first/last bin
+  vec2f histogramRange;
+  std::vector<size_t> histogram;
+  //! bricks that were not resident; their range was bounded by the
+  //! parent's, which makes min/max and the histogram approximate
+  size_t numMissing = 0;
+};
+
+struct PrefetchBrick
+{
+  int treeID;
+  int brickID;
+  int level;
+};
+
+/*! leads a residency snapshot: the bricks a forest had loaded, as
+    PrefetchBrick records, for the next run to preload. a snapshot is
+    only used by the forest it was taken of */
+struct ResidencySnapshotHeader
+{
+  char magic[8];
+  uint32_t numTrees;
+  int32_t brickSize;
+  uint32_t voxelBytes;
+  uint32_t numBricks;
+
+  static ResidencySnapshotHeader make(uint32_t numTrees, int32_t brickSize,
+                                      uint32_t voxelBytes, uint32_t numBricks)
+  {
+    ResidencySnapshotHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, "BTRESID", 8);
+    h.numTrees   = numTrees;
+    h.brickSize  = brickSize;
+    h.voxelBytes = voxelBytes;
+    h.numBricks  = numBricks;
+    return h;
+  }
+
+  bool sameForest(const ResidencySnapshotHeader &other) const
+  {
+    return memcmp(magic, other.magic, sizeof(magic)) == 0
+           && numTrees == other.numTrees && brickSize == other.brickSize
+           && voxelBytes == other.voxelBytes;
   }
-  int8_t isRequested;
-  int8_t isLoaded;
-  float loadWeight;
-  //vec2f valueRange;   /*8*/
 };
 
 template<int N, typename T>
@@ -160,6 +514,9 @@ struct BrickTree
   size_t valueBricksOfs;  /*8*/
   size_t indexBrickOfOfs; /*8*/
 
+  /*! global ID of this tree's first value brick in the forest arena */
+  size_t firstValueBrick; /*8*/
+
   float avgValue;     /*4*/
   int32_t nBrickSize; /*4*/
 
@@ -167,11 +524,15 @@ struct BrickTree
   vec3i validSize;    /*12*/
   vec3i rootGridDims; /*12*/
   int32_t depth;
+  /*! set once the index bricks have been read; until then the tree
+      samples as its average value */
+  int32_t isOpen = 0;
 
   ValueBrick *valueBrick = nullptr; /*8*/
   IndexBrick *indexBrick = nullptr; /*8*/
   BrickInfo *brickInfo = nullptr; /*8*/
-  BrickStatus *valueBricksStatus = nullptr; /*8*/
+  uint64_t *requestedBits = nullptr; /*8*/
+  uint64_t *loadedBits = nullptr;    /*8*/
 
   size_t **vbIdxByLevelBuffers = nullptr;
   size_t *vbIdxByLevelStride = nullptr;
@@ -190,24 +551,124 @@ struct BrickTree
   int brickSize() const
   { return N; }
 
+  bool isRequested(size_t brickID) const
+  { return testBrickBit(requestedBits, brickID); }
+  bool isLoaded(size_t brickID) const
+  { return testBrickBit(loadedBits, brickID); }
+
+  /*! request a brick, returns whether it had been requested before */
+  bool request(size_t brickID)
+  { return testAndSetBrickBit(requestedBits, brickID); }
+  /*! publish a brick once its data has been written */
+  void markLoaded(size_t brickID)
+  { testAndSetBrickBit(loadedBits, brickID); }
+
+  bool needsLoad(size_t brickID) const
+  { return !isLoaded(brickID) && isRequested(brickID); }
+
   vec3i getRootGridDims() const
   { return rootGridDims; }
 
   /*! map this one from a binary dump that was created by the
-   * bricktreebuilder/raw2bricks tool */
-  void mapOSP(const FileName &brickFileBase, int treeID, vec3i treeCoord);
-  void mapOspBin(const FileName &brickFileBase, size_t treeID);
-  void loadBricks(FILE *file, vec2i vbListInfo);
-  void loadBricks(FILE *file, LoadBricks aBrick);
-  void loadTreeByBrick(const FileName &brickFileBase,
+   * bricktreebuilder/raw2bricks tool; only reads the header, the brick
+   * arrays are slices of the forest arena assigned afterwards */
+  void mapOSP(BrickSource &source, int treeID, vec3i treeCoord);
+  void mapIndex(BrickSource &source, int treeID);
+
+  bool opened() const
+  { return __atomic_load_n(&isOpen, __ATOMIC_ACQUIRE) != 0; }
+  void markOpened()
+  { __atomic_store_n(&isOpen, 1, __ATOMIC_RELEASE); }
+
+  BrickTreeManifestEntry manifestEntry() const
+  {
+    BrickTreeManifestEntry e;
+    e.numValueBricks  = numValueBricks;
+    e.numIndexBricks  = numIndexBricks;
+    e.numBrickInfos   = numBrickInfos;
+    e.indexBricksOfs  = indexBricksOfs;
+    e.valueBricksOfs  = valueBricksOfs;
+    e.indexBrickOfOfs = indexBrickOfOfs;
+    e.avgValue        = avgValue;
+    e.nBrickSize      = nBrickSize;
+    e.valueRange[0]   = valueRange.x;
+    e.valueRange[1]   = valueRange.y;
+    e.validSize[0]    = validSize.x;
+    e.validSize[1]    = validSize.y;
+    e.validSize[2]    = validSize.z;
+    e.depth           = depth;
+    e.binBytes        = 0;
+    e.binMTime        = 0;
+    return e;
+  }
+
+  void setManifestEntry(const BrickTreeManifestEntry &e)
+  {
+    numValueBricks  = e.numValueBricks;
+    numIndexBricks  = e.numIndexBricks;
+    numBrickInfos   = e.numBrickInfos;
+    indexBricksOfs  = e.indexBricksOfs;
+    valueBricksOfs  = e.valueBricksOfs;
+    indexBrickOfOfs = e.indexBrickOfOfs;
+    avgValue        = e.avgValue;
+    nBrickSize      = e.nBrickSize;
+    valueRange      = vec2f(e.valueRange[0], e.valueRange[1]);
+    validSize       = vec3i(e.validSize[0], e.validSize[1], e.validSize[2]);
+    depth           = e.depth;
+  }
+  void mapOspBin(BrickSource &source, size_t treeID);
+  /*! read runs of value bricks, (first brick, count) each, and mark
+      them loaded */
+  void loadBricks(BrickSource &source, size_t treeID,
+                  const std::vector<vec2i> &vbListInfo);
+  void loadTreeByBrick(BrickSource &source,
                        size_t treeID,
                        std::vector<int> vbList);
-  void loadTreeByBrick(const FileName &brickFileBase,
+  void loadTreeByBrick(BrickSource &source,
                        size_t treeID,
                        std::vector<vec2i> vbReqList);
-  void loadTreeByBrick(const FileName &brickFileBase, size_t treeID);
+  void loadTreeByBrick(BrickSource &source, size_t treeID);
 
-  const T findValue(const int blockID, const vec3i &coord, int blockWidth);
+  const T findValue(const int blockID,
+                    const vec3i &coord,
+                    const BrickLevelTable &levels);
+  /*! look up the corners in 'cornerMask' of coords[8] at once; all of
+      them have to lie in this tree. corners sharing a brick share the
+      descent down to it */
+  void findValues(const int blockID,
+                  const vec3i *coords,
+                  int cornerMask,
+                  const BrickLevelTable &levels,
+                  T *values,
+                  int maxLevel = BrickLevelTable::maxLevels);
+  void findValuesRec(const int blockID,
+                     int32_t brickID,
+                     int32_t parentBrickID,
+                     int level,
+                     const vec3i *coords,
+                     int cornerMask,
+                     const BrickLevelTable &levels,
+                     T *values,
+                     int maxLevel);
+  /*! look up 'count' distinct coordinates of this tree, sorted by the
+      morton code of their position in the tree, so the coordinates of
+      every cell on every level form one run; each run shares the
+      descent through its cell */
+  void findSortedValues(const int blockID,
+                        const vec3i *coords,
+                        size_t count,
+                        const BrickLevelTable &levels,
+                        T *values,
+                        int maxLevel = BrickLevelTable::maxLevels);
+  void findSortedValuesRec(const int blockID,
+                           int32_t brickID,
+                           int32_t parentBrickID,
+                           int level,
+                           const vec3i *coords,
+                           size_t count,
+                           const BrickLevelTable &levels,
+                           T *values,
+                           int maxLevel);
   const T findBrickValue(const int blockID,
                          const size_t brickID,
                          const vec3i cellPos,
@@ -239,21 +700,33 @@ struct BrickTree
     return vbIDs;
   }
 
-  void reorganizeValueBrickBufferByLevel()
+  /*! every value brick lives on exactly one level, so the per-level
+      lists together fit in 'entries' (numValueBricks long) */
+  void reorganizeValueBrickBufferByLevel(size_t *entries)
   {
     for (int i = 0; i < depth; i++) {
       std::vector<size_t> vbsByLevel = getValueBrickIDsByLevel(i);
       vbIdxByLevelStride[i] = vbsByLevel.size();
-      *(vbIdxByLevelBuffers + i) = (size_t *) malloc(sizeof(size_t) * vbIdxByLevelStride[i]);
-      std::copy(vbsByLevel.begin(), vbsByLevel.end(), *(vbIdxByLevelBuffers + i));
+      vbIdxByLevelBuffers[i] = entries;
+      std::copy(vbsByLevel.begin(), vbsByLevel.end(), entries);
+      entries += vbsByLevel.size();
+    }
+  }
+
+  /*! point the per-level lists at 'entries' after another process
+      filled them (and the strides) in a shared arena */
+  void adoptValueBrickBufferByLevel(size_t *entries)
+  {
+    for (int i = 0; i < depth; i++) {
+      vbIdxByLevelBuffers[i] = entries;
+      entries += vbIdxByLevelStride[i];
     }
   }
 
   bool isTreeNeedLoad()
   {
     for (size_t i = 0; i < numValueBricks; i++) {
-      if (!valueBricksStatus[i].isLoaded &&
-        valueBricksStatus[i].isRequested) {
+      if (needsLoad(i)) {
         return true;
       }
     }
@@ -271,19 +744,683 @@ struct BrickTreeForest
   const vec3i originalVolumeSize;
   const int depth;
   const FileName &brickFileBase;
+  /*! where the trees' files are read from; next to brickFileBase by
+      default */
+  std::shared_ptr<BrickSource> source;
 
   vec2f valueRange;
 
   std::thread loadBrickTreeThread[numThread];
+  /*! follows the owner's loaders in a process attached to a shared
+      arena */
+  std::thread followThread;
+  /*! set by the destructor; the loaders and the follower return before
+      the trees and the arena go away */
+  std::atomic<bool> stopLoaders{false};
 
   box3f forestBounds;
 
   std::vector<BrickTree<N, T>> tree;
 
+  /*! bricks, indices and residency bits of all trees */
+  BrickArena arena;
+  const BrickArena::Placement placement;
+  /*! numa node each tree's value bricks were placed on (NUMA_PARTITION) */
+  std::vector<int> treeNode;
+  /*! arena storage for the per-level value brick lists, indexed by
+      global brick ID */
+  size_t *levelEntries = nullptr;
+  /*! trees are opened by whichever thread needs them first */
+  std::mutex openMtx[64];
+  /*! per tree: 0 if it is fully transparent under the current transfer
+      function; written by the volume on transfer function changes */
+  std::vector<uint8_t> treeVisible;
+  /*! per tree its TreeResidence on this rank; absent trees take no arena
+      space and are never opened, so they sample as their average */
+  std::vector<uint8_t> treeResidence;
+
+  /*! leads a shared arena; the processes attached to it follow the
+      owner's loader through it */
+  struct SharedHeader
+  {
+    char magic[8];
+    uint64_t arenaBytes;
+    uint32_t numTrees;
+    int32_t ownerPid;
+    std::atomic<uint32_t> ready;
+    std::atomic<uint64_t> generation;
+  };
+  SharedHeader *sharedHeader = nullptr;
+  /*! per tree: set by the owner of a shared arena once it opened it */
+  uint8_t *sharedOpen = nullptr;
+  /*! set in an attached process once the owner of the shared arena is
+      gone; nobody loads bricks or opens trees for it any more */
+  std::atomic<bool> sharedOwnerLost{false};
+  /*! per-process pointers into levelEntries; pointers cannot live in a
+      shared arena as every process maps it at a different address */
+  std::vector<size_t *> levelBuffers;
+  /*! per tree the IDs of its 26 neighbors and itself, -1 past the
+      forest's border; the tree at offset (dx,dy,dz) in {-1,0,1}^3 is
+      treeNeighbors[27*treeID + neighborIndex(dx,dy,dz)] */
+  std::vector<int32_t> treeNeighbors;
+  /*! shift/mask decomposition of the forest's coordinates */
+  BrickLevelTable levels;
+  /*! sorted queries per parallel task in sampleMany */
+  static const size_t sampleChunkSize = 1024;
+  /*! value brick with global ID 'i' is valueBricks[i] */
+  typename BrickTree<N, T>::ValueBrick *valueBricks = nullptr;
+
+  /*! bumped every time the loader made newly requested bricks resident;
+      clients poll it to find out when coarse fallback samples in their
+      accumulation buffer have become stale */
+  std::atomic<size_t> residencyGeneration{0};
+
+  /*! low-priority bricks for a predicted view, coarse levels first; the
+      loader only works on them once no demand requests are left */
+  std::mutex prefetchMtx;
+  std::vector<PrefetchBrick> prefetchQueue;
+  size_t prefetchNext = 0;
+  static const size_t maxPrefetchBricks = 1 << 16;
+  static const size_t prefetchBatchSize = 64;
+  /*! control socket of the brick server owning the shared arena, if
+      any; prefetches and cancels go there, as its loaders fill it */
+  std::shared_ptr<BrickServerConnection> brickServer;
+
+  int blockWidth() const
+  {
+    int width = 1;
+    for (int i = 0; i < depth; i++)
+      width *= N;
+    return width;
+  }
+
+  static int neighborIndex(int dx, int dy, int dz)
+  {
+    return (dz + 1) * 9 + (dy + 1) * 3 + (dx + 1);
+  }
+
+  void buildTreeNeighbors()
+  {
+    const int numTrees = forestSize.product();
+    treeNeighbors.resize(27 * size_t(numTrees));
+    tasking::parallel_for(numTrees, [&](int treeID) {
+      const vec3i c = treeCoord(treeID);
+      for (int dz = -1; dz <= 1; dz++)
+        for (int dy = -1; dy <= 1; dy++)
+          for (int dx = -1; dx <= 1; dx++) {
+            const vec3i n = c + vec3i(dx, dy, dz);
+            const bool inside = n.x >= 0 && n.y >= 0 && n.z >= 0
+                                && n.x < forestSize.x && n.y < forestSize.y
+                                && n.z < forestSize.z;
+            treeNeighbors[27 * size_t(treeID) + neighborIndex(dx, dy, dz)] =
+              inside ? n.x + forestSize.x * (n.y + forestSize.y * n.z) : -1;
+          }
+    });
+  }
+
+  /*! tree of a voxel inside the volume */
+  int treeID(const vec3i &voxel) const
+  {
+    const vec3i t = min(levels.treePos(voxel), forestSize - 1);
+    return t.x + forestSize.x * (t.y + forestSize.y * t.z);
+  }
+
+  /*! whether this rank may open (and load bricks of) a tree; a shared
+      arena holds every tree, as the ranks sharing it own different ones */
+  bool isResident(size_t treeID) const
+  {
+    return isShared() || treeResidence[treeID] != TREE_ABSENT;
+  }
+
+  bool isShared() const
+  {
+    return !placement.sharedName.empty();
+  }
+
+  /*! words of a tree's residency bitsets; absent trees keep one line so
+      a sampler's request for their root stays inside their own bits */
+  static size_t treeBitsWords(const BrickTree<N, T> &t)
+  {
+    return brickBitsWords(std::max<size_t>(t.numValueBricks, 1));
+  }
+
+  /*! trilinearly interpolated sample at 'pos', refining no deeper than
+      'maxLevel'. the corners are grouped by tree (trees straddled are
+      found through the neighbor table) and each group is resolved with
+      one shared descent */
+  float sample(const vec3f &pos, int maxLevel = BrickLevelTable::maxLevels)
+  {
+    const vec3i low    = vec3i(pos);
+    const vec3f factor = pos - vec3f(low);
+    const vec3i lo = max(vec3i(0), min(originalVolumeSize - 1, low));
+    const vec3i hi = max(vec3i(0), min(originalVolumeSize - 1, low + 1));
+    vec3i coords[8];
+    for (int i = 0; i < 8; i++)
+      coords[i] = vec3i((i & 1) ? hi.x : lo.x,
+                        (i & 2) ? hi.y : lo.y,
+                        (i & 4) ? hi.z : lo.z);
+
+    // corner (x,y,z) of the cell is v[z][y][x]
+    T v[2][2][2];
+    T *values = &v[0][0][0];
+    const int treeLo  = treeID(lo);
+    const vec3i cross = levels.treePos(hi) - levels.treePos(lo);
+    if (cross == vec3i(0)) {
+      tree[treeLo].findValues(treeLo, coords, 0xff, levels, values, maxLevel);
+    } else {
+      const int32_t *neighbors = &treeNeighbors[27 * size_t(treeLo)];
+      int cornerTree[8];
+      for (int i = 0; i < 8; i++)
+        cornerTree[i] = neighbors[neighborIndex((i & 1) ? cross.x : 0,
+                                                (i & 2) ? cross.y : 0,
+                                                (i & 4) ? cross.z : 0)];
+      int todo = 0xff;
+      while (todo) {
+        const int i = __builtin_ctz(todo);
+        int group = 0;
+        for (int j = i; j < 8; j++)
+          if (((todo >> j) & 1) && cornerTree[j] == cornerTree[i])
+            group |= 1 << j;
+        todo &= ~group;
+        tree[cornerTree[i]].findValues(cornerTree[i], coords, group, levels,
+                                       values, maxLevel);
+      }
+    }
+
+    return trilinear(values, factor);
+  }
+
+  /*! interpolate the corners v[z][y][x] of a cell, flattened */
+  static float trilinear(const T *v, const vec3f &factor)
+  {
+    const float v00 = v[0] + factor.x * (v[1] - v[0]);
+    const float v01 = v[2] + factor.x * (v[3] - v[2]);
+    const float v10 = v[4] + factor.x * (v[5] - v[4]);
+    const float v11 = v[6] + factor.x * (v[7] - v[6]);
+    const float v0  = v00 + factor.y * (v01 - v00);
+    const float v1  = v10 + factor.y * (v11 - v10);
+    return v0 + factor.z * (v1 - v0);
+  }
+
+  /*! sample 'count' positions at once. queries are sorted by tree and
+      by the morton order of their finest brick and processed in chunks
+      in parallel. within a chunk the corners of each tree's run of
+      queries are deduplicated and looked up with one batched descent
+      (BrickTree::findSortedValues), so neighboring queries share their
+      index bricks and voxels; queries whose cell straddles trees take
+      sample(). the traversal is scalar c++, SIMD lanes are only used by
+      the ispc batch behind BrickTreeVolume::sampleMany */
+  void sampleMany(const vec3f *pos, float *values, size_t count,
+                  int maxLevel = BrickLevelTable::maxLevels)
+  {
+    if (count == 0)
+      return;
+    const int m = levels.mask(0);
+    std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+    tasking::parallel_for(count, [&](size_t i) {
+      const vec3i lo = max(vec3i(0), min(originalVolumeSize - 1, vec3i(pos[i])));
+      const uint64_t t = treeID(lo);
+      keys[i] = std::make_pair(levels.sortKey(t, lo), (uint32_t)i);
+    });
+    std::sort(keys.begin(), keys.end());
+
+    const size_t numChunks = (count + sampleChunkSize - 1) / sampleChunkSize;
+    tasking::parallel_for(numChunks, [&](size_t chunk) {
+      const size_t first = chunk * sampleChunkSize;
+      const size_t end   = std::min(count, first + sampleChunkSize);
+      // per query its tree (-1 if sampled alone) and its corners
+      std::vector<int> queryTree(end - first);
+      std::vector<vec3i> cornerCoord(8 * (end - first));
+      std::vector<T> cornerValue(8 * (end - first));
+      for (size_t q = 0; q < end - first; q++) {
+        const vec3f &p = pos[keys[first + q].second];
+        const vec3i lo = max(vec3i(0), min(originalVolumeSize - 1, vec3i(p)));
+        const vec3i hi = max(vec3i(0), min(originalVolumeSize - 1, vec3i(p) + 1));
+        queryTree[q] = levels.treePos(hi) == levels.treePos(lo) ? treeID(lo) : -1;
+        for (int c = 0; c < 8; c++)
+          cornerCoord[8 * q + c] = vec3i((c & 1) ? hi.x : lo.x,
+                                         (c & 2) ? hi.y : lo.y,
+                                         (c & 4) ? hi.z : lo.z);
+      }
+
+      std::vector<std::pair<uint64_t, uint32_t>> corners;
+      std::vector<vec3i> voxels;
+      std::vector<T> voxelValues;
+      for (size_t q0 = 0, q1; q0 < end - first; q0 = q1) {
+        const int t = queryTree[q0];
+        for (q1 = q0 + 1; q1 < end - first && queryTree[q1] == t; q1++)
+          ;
+        if (t < 0)
+          continue;
+        // the run's distinct corner voxels in morton order
+        corners.clear();
+        for (size_t q = q0; q < q1; q++)
+          for (int c = 0; c < 8; c++) {
+            const vec3i &v = cornerCoord[8 * q + c];
+            corners.emplace_back(mortonCode3(v.x & m, v.y & m, v.z & m),
+                                 uint32_t(8 * q + c));
+          }
+        std::sort(corners.begin(), corners.end());
+        voxels.clear();
+        for (size_t k = 0; k < corners.size(); k++)
+          if (k == 0 || corners[k].first != corners[k - 1].first)
+            voxels.push_back(cornerCoord[corners[k].second]);
+        voxelValues.resize(voxels.size());
+        tree[t].findSortedValues(t, voxels.data(), voxels.size(), levels,
+                                 voxelValues.data(), maxLevel);
+        for (size_t k = 0, v = 0; k < corners.size(); k++) {
+          if (k > 0 && corners[k].first != corners[k - 1].first)
+            v++;
+          cornerValue[corners[k].second] = voxelValues[v];
+        }
+      }
+
+      for (size_t q = 0; q < end - first; q++) {
+        const uint32_t i = keys[first + q].second;
+        if (queryTree[q] < 0) {
+          values[i] = sample(pos[i], maxLevel);
+          continue;
+        }
+        const vec3f factor = pos[i] - vec3f(vec3i(pos[i]));
+        values[i] = trilinear(&cornerValue[8 * q], factor);
+      }
+    });
+  }
+
+  /*! a brick contributing to an extracted region: either a resident
+      brick whose unrefined cells are copied, or (fill) the stand-in for
+      a missing brick, whose extent gets the value of the covering cell
+      of its nearest resident ancestor, or the tree's average */
+  struct RegionBrick
+  {
+    int treeID;
+    int32_t brickID; // invalidID() for the tree's average
+    int level;
+    vec3i origin;    // voxel coordinates of the brick
+    bool fill;
+    box3i fillBox;   // voxel coordinates, only for fill
+  };
+
+  /*! collect the bricks of a tree intersecting 'voxels' down to 'level' */
+  void collectRegionBricks(int treeID, int32_t brickID, int level,
+                           const vec3i &origin, int maxLevel,
+                           const box3i &voxels, bool loadMissing,
+                           std::vector<RegionBrick> &bricks,
+                           std::vector<int> &missing)
+  {
+    BrickTree<N, T> &t = tree[treeID];
+    if (!t.isLoaded(brickID)) {
+      missing.push_back(brickID);
+      if (!loadMissing) {
+        // the caller resolves the stand-in from the ancestors
+        bricks.push_back(RegionBrick{treeID, brickID, level, origin, true,
+          box3i(origin, origin + vec3i(1 << levels.shift[level]))});
+        return;
+      }
+    }
+    bricks.push_back(RegionBrick{treeID, brickID, level, origin, false,
+                                 box3i()});
+    const int32_t ibID = t.brickInfo[brickID].indexBrickID;
+    if (level >= maxLevel || ibID == BrickTree<N, T>::invalidID())
+      return;
+    const int cellW = 1 << levels.shift[level + 1];
+    for (int iz = 0; iz < N; iz++)
+      for (int iy = 0; iy < N; iy++)
+        for (int ix = 0; ix < N; ix++) {
+          const int32_t child = t.indexBrick[ibID].childID[iz][iy][ix];
+          if (child == BrickTree<N, T>::invalidID())
+            continue;
+          const vec3i lower = origin + vec3i(ix, iy, iz) * cellW;
+          if (!overlaps(box3i(lower, lower + vec3i(cellW)), voxels))
+            continue;
+          collectRegionBricks(treeID, child, level + 1, lower, maxLevel,
+                              voxels, loadMissing, bricks, missing);
+        }
+  }
+
+  /*! walk down towards 'brickID' along 'voxel' and return the deepest
+      resident brick on the way (invalidID() if the root is missing) */
+  void findAncestor(const BrickTree<N, T> &t, const vec3i &voxel,
+                    int32_t brickID, int32_t &ancestor, int &ancestorLevel)
+  {
+    ancestor      = BrickTree<N, T>::invalidID();
+    ancestorLevel = -1;
+    int32_t cur   = 0;
+    for (int l = 0; cur != brickID; l++) {
+      if (!t.isLoaded(cur))
+        return;
+      ancestor      = cur;
+      ancestorLevel = l;
+      const int32_t ibID = t.brickInfo[cur].indexBrickID;
+      if (ibID == BrickTree<N, T>::invalidID())
+        return;
+      const vec3i c = levels.cellPos(voxel, l);
+      cur = t.indexBrick[ibID].childID[c.z][c.y][c.x];
+      if (cur == BrickTree<N, T>::invalidID())
+        return;
+    }
+  }
+
+  /*! copy a box of the forest into a dense array. 'region' is given in
+      cells of 'level' (level depth-1 is full resolution, level 0 cells
+      are 1/N of a tree) and 'out' receives region.size().product()
+      values, x fastest. only bricks intersecting the region are walked,
+      cells not refined down to 'level' are expanded, and the bricks are
+      written in parallel. bricks that are not resident are loaded
+      synchronously if 'loadMissing' is set; otherwise their nearest
+      resident ancestor stands in. returns the number of bricks that
+      were not resident */
+  size_t extractRegion(const box3i &region, int level, T *out,
+                       bool loadMissing = true)
+  {
+    if (level < 0 || level >= depth)
+      throw std::runtime_error("BrickTreeForest::extractRegion: level "
+                               + std::to_string(level) + " not in [0,"
+                               + std::to_string(depth) + ")");
+    const int outShift = levels.shift[level + 1];
+    const vec3i levelSize =
+      shiftRight(originalVolumeSize + vec3i((1 << outShift) - 1), outShift);
+    if (reduce_min(region.size()) <= 0)
+      return 0;
+    if (reduce_min(region.lower) < 0
+        || reduce_min(levelSize - region.upper) < 0)
+      throw std::runtime_error("BrickTreeForest::extractRegion: region "
+                               "exceeds the volume");
+
+    const vec3i dims = region.size();
+    const box3i voxels(shiftLeft(region.lower, outShift),
+                       min(shiftLeft(region.upper, outShift),
+                           originalVolumeSize));
+    const vec3i treeLo = levels.treePos(voxels.lower);
+    const vec3i treeHi = min(levels.treePos(voxels.upper - 1), forestSize - 1);
+    std::vector<int> trees;
+    for (int z = treeLo.z; z <= treeHi.z; z++)
+      for (int y = treeLo.y; y <= treeHi.y; y++)
+        for (int x = treeLo.x; x <= treeHi.x; x++)
+          trees.push_back(x + forestSize.x * (y + forestSize.y * z));
+
+    // pass 1, per tree: find the bricks, load what's missing
+    std::vector<std::vector<RegionBrick>> treeBricks(trees.size());
+    std::atomic<size_t> numMissing{0};
+    tasking::parallel_for(trees.size(), [&](size_t i) {
+      const int treeID = trees[i];
+      BrickTree<N, T> &t = tree[treeID];
+      const vec3i origin = shiftLeft(treeCoord(treeID), levels.blockShift);
+      if (!t.opened() && (!loadMissing || !isResident(treeID))) {
+        numMissing++;
+        treeBricks[i].push_back(RegionBrick{treeID, BrickTree<N, T>::invalidID(),
+          0, origin, true, box3i(origin, origin + vec3i(1 << levels.blockShift))});
+        return;
+      }
+      openTree(treeID);
+      std::vector<int> missing;
+      collectRegionBricks(treeID, 0, 0, origin, level, voxels, loadMissing,
+                          treeBricks[i], missing);
+      numMissing += missing.size();
+      if (loadMissing && !missing.empty()) {
+        for (int brickID : missing)
+          t.request(brickID);
+        t.loadTreeByBrick(*source, treeID, missing);
+        residencyGeneration++;
+      }
+    });
+
+    std::vector<RegionBrick> bricks;
+    for (auto &b : treeBricks)
+      bricks.insert(bricks.end(), b.begin(), b.end());
+
+    // pass 2, per brick: each brick writes the cells it is the finest
+    // available data for, so the writes never overlap
+    auto fillBox = [&](box3i cells, T value) {
+      cells.lower = max(cells.lower, region.lower);
+      cells.upper = min(cells.upper, region.upper);
+      if (cells.upper.x <= cells.lower.x)
+        return;
+      for (int z = cells.lower.z; z < cells.upper.z; z++)
+        for (int y = cells.lower.y; y < cells.upper.y; y++) {
+          T *row = out + (size_t(z - region.lower.z) * dims.y
+                          + (y - region.lower.y)) * dims.x
+                       - region.lower.x;
+          std::fill(row + cells.lower.x, row + cells.upper.x, value);
+        }
+    };
+    auto toCells = [&](const vec3i &lower, const vec3i &upper) {
+      return box3i(shiftRight(lower, outShift),
+                   shiftRight(upper + vec3i((1 << outShift) - 1), outShift));
+    };
+    tasking::parallel_for(bricks.size(), [&](size_t i) {
+      const RegionBrick &b = bricks[i];
+      const BrickTree<N, T> &t = tree[b.treeID];
+      if (b.fill) {
+        T value = t.avgValue;
+        if (b.brickID != BrickTree<N, T>::invalidID()) {
+          int32_t ancestor;
+          int ancestorLevel;
+          findAncestor(t, b.fillBox.lower, b.brickID, ancestor, ancestorLevel);
+          if (ancestor != BrickTree<N, T>::invalidID()) {
+            const vec3i c = levels.cellPos(b.fillBox.lower, ancestorLevel);
+            value = t.valueBrick[ancestor].value[c.z][c.y][c.x];
+          }
+        }
+        fillBox(toCells(b.fillBox.lower, b.fillBox.upper), value);
+        return;
+      }
+      const typename BrickTree<N, T>::ValueBrick &vb = t.valueBrick[b.brickID];
+      const int32_t ibID = t.brickInfo[b.brickID].indexBrickID;
+      const bool refine  = b.level < level && ibID != BrickTree<N, T>::invalidID();
+      const int cellW    = 1 << levels.shift[b.level + 1];
+      for (int iz = 0; iz < N; iz++)
+        for (int iy = 0; iy < N; iy++)
+          for (int ix = 0; ix < N; ix++) {
+            if (refine && t.indexBrick[ibID].childID[iz][iy][ix]
+                          != BrickTree<N, T>::invalidID())
+              continue;
+            const vec3i lower = b.origin + vec3i(ix, iy, iz) * cellW;
+            fillBox(toCells(lower, lower + vec3i(cellW)), vb.value[iz][iy][ix]);
+          }
+    });
+    return numMissing;
+  }
+
+  /*! per-task accumulator for regionStats() */
+  struct StatsAccumulator
+  {
+    StatsAccumulator(int numBins, const vec2f &range, float maxError)
+      : histogram(numBins, 0), range(range), maxError(maxError)
+    {}
+
+    int bin(float v) const
+    {
+      // a zero width (or inverted) range has everything in bin 0
+      if (!(range.y > range.x))
+        return 0;
+      const int n = (int)histogram.size();
+      const float f = (v - range.x) / (range.y - range.x) * n;
+      // clamped as a float, so huge values never overflow the int
+      return int(std::min(float(n - 1), std::max(0.f, f)));
+    }
+
+    /*! whether a part with values in [lo,hi] can be taken as a whole */
+    bool resolves(float lo, float hi) const
+    {
+      return histogram.empty() || hi - lo <= maxError || bin(lo) == bin(hi);
+    }
+
+    void add(float value, float lo, float hi, size_t voxels)
+    {
+      minValue = std::min(minValue, lo);
+      maxValue = std::max(maxValue, hi);
+      sum += double(value) * voxels;
+      numVoxels += voxels;
+      if (!histogram.empty())
+        histogram[bin(value)] += voxels;
+    }
+
+    std::vector<size_t> histogram;
+    vec2f range;
+    float maxError;
+    float minValue = std::numeric_limits<float>::infinity();
+    float maxValue = -std::numeric_limits<float>::infinity();
+    double sum = 0.;
+    size_t numVoxels = 0;
+    size_t numMissing = 0;
+  };
+
+  /*! make a tree's brick resident for a synchronous query; returns
+      false if it is missing and may not be loaded */
+  bool residentBrick(int treeID, int32_t brickID, bool loadMissing)
+  {
+    BrickTree<N, T> &t = tree[treeID];
+    if (t.isLoaded(brickID))
+      return true;
+    if (!loadMissing)
+      return false;
+    t.request(brickID);
+    t.loadTreeByBrick(*source, treeID, std::vector<int>(1, brickID));
+    residencyGeneration++;
+    return true;
+  }
+
+  void statsRec(int treeID, int32_t brickID, int level, const vec3i &origin,
+                const box3i &voxels, bool loadMissing, StatsAccumulator &acc)
+  {
+    const BrickTree<N, T> &t = tree[treeID];
+    const typename BrickTree<N, T>::ValueBrick &vb = t.valueBrick[brickID];
+    const int32_t ibID = t.brickInfo[brickID].indexBrickID;
+    const int cellW    = 1 << levels.shift[level + 1];
+    for (int iz = 0; iz < N; iz++)
+      for (int iy = 0; iy < N; iy++)
+        for (int ix = 0; ix < N; ix++) {
+          const vec3i lower = origin + vec3i(ix, iy, iz) * cellW;
+          const box3i cell(lower, min(lower + vec3i(cellW), originalVolumeSize));
+          const box3i part(max(cell.lower, voxels.lower),
+                           min(cell.upper, voxels.upper));
+          if (reduce_min(part.size()) <= 0)
+            continue;
+          const size_t n = part.size().long_product();
+          const float v  = vb.value[iz][iy][ix];
+          const int32_t child = ibID == BrickTree<N, T>::invalidID()
+                              ? BrickTree<N, T>::invalidID()
+                              : t.indexBrick[ibID].childID[iz][iy][ix];
+          // unrefined cells are (up to the build threshold) constant
+          if (child == BrickTree<N, T>::invalidID()) {
+            acc.add(v, v, v, n);
+            continue;
+          }
+          if (!residentBrick(treeID, child, loadMissing)) {
+            acc.numMissing++;
+            acc.add(v, vb.vRange[0], vb.vRange[1], n);
+            continue;
+          }
+          // a brick's range covers its whole subtree, and its cell values
+          // are weighted averages, so cells inside the box are exact for
+          // min/max/mean and only the histogram may have to look deeper
+          const typename BrickTree<N, T>::ValueBrick &cb = t.valueBrick[child];
+          const bool whole = part.lower == cell.lower && part.upper == cell.upper;
+          if (whole && acc.resolves(cb.vRange[0], cb.vRange[1]))
+            acc.add(v, cb.vRange[0], cb.vRange[1], n);
+          else
+            statsRec(treeID, child, level + 1, lower, voxels, loadMissing, acc);
+        }
+  }
+
+  /*! min/max, weighted mean and a histogram of 'numBins' bins over a
+      box of voxels, answered from the coarsest bricks possible: parts
+      inside the box are taken whole from a coarse cell (whose brick
+      range bounds all of its subtree) unless their range straddles
+      histogram bins by more than 'maxError'; parts straddling the box
+      border are refined. an empty histogramRange means the forest's
+      value range. missing bricks are loaded synchronously unless
+      'loadMissing' is false, in which case they are bounded by their
+      parent (see RegionStats::numMissing) */
+  RegionStats regionStats(const box3i &box, int numBins = 0,
+                          vec2f histogramRange = vec2f(0.f),
+                          float maxError = 0.f, bool loadMissing = true)
+  {
+    RegionStats stats;
+    if (!(histogramRange.x < histogramRange.y))
+      histogramRange = valueRange;
+    stats.histogramRange = histogramRange;
+    stats.histogram.assign(std::max(0, numBins), 0);
+
+    const box3i voxels(max(box.lower, vec3i(0)),
+                       min(box.upper, originalVolumeSize));
+    if (reduce_min(voxels.size()) <= 0)
+      return stats;
+
+    const vec3i treeLo = levels.treePos(voxels.lower);
+    const vec3i treeHi = min(levels.treePos(voxels.upper - 1), forestSize - 1);
+    std::vector<int> trees;
+    for (int z = treeLo.z; z <= treeHi.z; z++)
+      for (int y = treeLo.y; y <= treeHi.y; y++)
+        for (int x = treeLo.x; x <= treeHi.x; x++)
+          trees.push_back(x + forestSize.x * (y + forestSize.y * z));
+
+    std::mutex statsMtx;
+    StatsAccumulator total(numBins, histogramRange, maxError);
+    tasking::parallel_for(trees.size(), [&](size_t i) {
+      const int treeID = trees[i];
+      BrickTree<N, T> &t = tree[treeID];
+      StatsAccumulator acc(numBins, histogramRange, maxError);
+
+      // whole trees are decided from their manifest entry alone
+      const vec3i origin = shiftLeft(treeCoord(treeID), levels.blockShift);
+      const box3i extent(origin, min(origin + vec3i(blockWidth()),
+                                     originalVolumeSize));
+      const box3i part(max(extent.lower, voxels.lower),
+                       min(extent.upper, voxels.upper));
+      const size_t n = part.size().long_product();
+      const bool whole = part.lower == extent.lower && part.upper == extent.upper;
+      if (whole && acc.resolves(t.valueRange.x, t.valueRange.y)) {
+        acc.add(t.avgValue, t.valueRange.x, t.valueRange.y, n);
+      } else if (!t.opened() && (!loadMissing || !isResident(treeID))) {
+        acc.numMissing++;
+        acc.add(t.avgValue, t.valueRange.x, t.valueRange.y, n);
+      } else {
+        openTree(treeID);
+        if (residentBrick(treeID, 0, loadMissing)) {
+          statsRec(treeID, 0, 0, origin, voxels, loadMissing, acc);
+        } else {
+          acc.numMissing++;
+          acc.add(t.avgValue, t.valueRange.x, t.valueRange.y, n);
+        }
+      }
+
+      std::lock_guard<std::mutex> lock(statsMtx);
+      total.minValue = std::min(total.minValue, acc.minValue);
+      total.maxValue = std::max(total.maxValue, acc.maxValue);
+      total.sum        += acc.sum;
+      total.numVoxels  += acc.numVoxels;
+      total.numMissing += acc.numMissing;
+      for (size_t b = 0; b < acc.histogram.size(); b++)
+        total.histogram[b] += acc.histogram[b];
+    });
+
+    stats.minValue   = total.minValue;
+    stats.maxValue   = total.maxValue;
+    stats.numVoxels  = total.numVoxels;
+    stats.mean       = total.numVoxels ? total.sum / total.numVoxels : 0.;
+    stats.histogram  = total.histogram;
+    stats.numMissing = total.numMissing;
+    return stats;
+  }
+
+  vec3i treeCoord(int treeID) const
+  {
+    return vec3i(treeID % forestSize.x,
+                 (treeID / forestSize.x) % forestSize.y,
+                 treeID / (forestSize.x * forestSize.y));
+  }
+
+  box3f treeBounds(int treeID) const
+  {
+    const vec3f lower(treeCoord(treeID) * blockWidth());
+    return box3f(lower, lower + vec3f(tree[treeID].validSize));
+  }
+
   bool vbNeed2Load(size_t treeID, int vbID)
   {
-    return (!tree[treeID].valueBricksStatus[vbID].isLoaded) &&
-      tree[treeID].valueBricksStatus[vbID].isRequested;
+    return tree[treeID].needsLoad(vbID);
   }
 
   // get the request value brick list
@@ -295,8 +1432,7 @@ struct BrickTreeForest
     std::vector<vec2i> scheduledVB;
     std::stack<int> sIdxStack;
     for (int i = 0; i < (int) bt.numValueBricks; i++) {
-      if (!bt.valueBricksStatus[i].isLoaded &&
-        bt.valueBricksStatus[i].isRequested) {
+      if (bt.needsLoad(i)) {
         if (sIdxStack.empty()) {
           sIdxStack.push(i);
         }
@@ -317,7 +1453,328 @@ struct BrickTreeForest
     return scheduledVB;
   }
 
-  void loadTreeBrick(const FileName &brickFileBase)
+  /*! replace the prefetch queue with the bricks the given view will
+      need: trees are culled against the view cone, then each tree's
+      resident index bricks are walked down to the level the LOD table
+      picks for the distance to the predicted camera position */
+  void prefetch(const PrefetchView &view, const std::vector<float> &lodDistance)
+  {
+    const float tanHalf = tanf(deg2rad(0.5f * view.fovy))
+                          * sqrtf(1.f + view.aspect * view.aspect);
+    const float halfAngle = atanf(tanHalf);
+    const vec3f dir = normalize(view.dir);
+
+    auto inView = [&](const vec3f &center, float radius) {
+      const vec3f v = center - view.pos;
+      const float d = length(v);
+      if (d <= radius)
+        return true;
+      const float angle = acosf(max(-1.f, min(1.f, dot(v, dir) / d)));
+      return angle <= halfAngle + asinf(radius / d);
+    };
+
+    const int width = blockWidth();
+    std::vector<std::vector<PrefetchBrick>> perTree(tree.size());
+
+    tasking::parallel_for(tree.size(), [&](size_t treeID)
+    {
+      // ghost trees are only read along the borders, on demand
+      if (!treeVisible[treeID] || treeResidence[treeID] != TREE_OWNED)
+        return;
+      const box3f bounds = treeBounds(treeID);
+      if (!inView(0.5f * (bounds.lower + bounds.upper),
+                  0.5f * length(bounds.upper - bounds.lower)))
+        return;
+
+      BrickTree<N, T> &bt = tree[treeID];
+      if (!bt.opened()) {
+        // only the root is known before the tree is opened
+        if (!bt.isRequested(0))
+          perTree[treeID].push_back({int(treeID), 0, 0});
+        return;
+      }
+      struct Node { int brickID; vec3i lower; int width; int level; };
+      std::stack<Node> stack;
+      stack.push({0, treeCoord(treeID) * width, width, 0});
+      while (!stack.empty()) {
+        const Node n = stack.top();
+        stack.pop();
+
+        const vec3f c = vec3f(n.lower) + vec3f(0.5f * n.width);
+        const float r = 0.5f * sqrtf(3.f) * n.width;
+        if (!inView(c, r))
+          continue;
+
+        if (!bt.isLoaded(n.brickID) && !bt.isRequested(n.brickID))
+          perTree[treeID].push_back({int(treeID), n.brickID, n.level});
+
+        const float t = max(0.f, length(c - view.pos) - r);
+        if (n.level >= (int) lodDistance.size() || t >= lodDistance[n.level])
+          continue;
+
+        const int ibID = bt.brickInfo[n.brickID].indexBrickID;
+        if (ibID == BrickTree<N, T>::invalidID())
+          continue;
+        const int cellWidth = n.width / N;
+        array3D::for_each(vec3i(N), [&](const vec3i &idx)
+        {
+          const int cvbID = bt.indexBrick[ibID].childID[idx.z][idx.y][idx.x];
+          if (cvbID != BrickTree<N, T>::invalidID())
+            stack.push({cvbID, n.lower + idx * cellWidth, cellWidth, n.level + 1});
+        });
+      }
+    });
+
+    std::vector<PrefetchBrick> queue;
+    for (auto &bricks : perTree)
+      queue.insert(queue.end(), bricks.begin(), bricks.end());
+    if (!brickServer) {
+      setPrefetchQueue(std::move(queue));
+      return;
+    }
+    // the server merges the bricks of all its clients by priority
+    orderPrefetchQueue(queue);
+    std::vector<BrickServerRequest> requests;
+    requests.reserve(queue.size());
+    for (const PrefetchBrick &b : queue)
+      requests.push_back({b.treeID, b.brickID, b.level + 1});
+    brickServer->request(requests);
+  }
+
+  /*! coarse levels first, capped at maxPrefetchBricks */
+  static void orderPrefetchQueue(std::vector<PrefetchBrick> &queue)
+  {
+    std::stable_sort(queue.begin(), queue.end(),
+                     [](const PrefetchBrick &a, const PrefetchBrick &b)
+                     { return a.level < b.level; });
+    if (queue.size() > maxPrefetchBricks)
+      queue.resize(maxPrefetchBricks);
+  }
+
+  /*! replace the prefetch queue with the given bricks */
+  void setPrefetchQueue(std::vector<PrefetchBrick> queue)
+  {
+    orderPrefetchQueue(queue);
+    std::lock_guard<std::mutex> lock(prefetchMtx);
+    prefetchQueue.swap(queue);
+    prefetchNext = 0;
+  }
+
+  /*! drop every prefetch request that has not been picked up yet; a
+      batch already being loaded still finishes */
+  void cancelPrefetch()
+  {
+    if (brickServer) {
+      brickServer->cancel();
+      return;
+    }
+    std::lock_guard<std::mutex> lock(prefetchMtx);
+    prefetchQueue.clear();
+    prefetchNext = 0;
+  }
+
+  /*! how many bricks were requested and are loaded right now, summed
+      over the residency bitsets, and the bytes read so far; with a
+      brick server the reads happen in the server's process */
+  BrickCounts brickCounts() const
+  {
+    BrickCounts counts;
+    for (const BrickTree<N, T> &t : tree) {
+      const size_t numWords = (t.numValueBricks + 63) / 64;
+      for (size_t w = 0; w < numWords; w++) {
+        counts.requested += __builtin_popcountll(
+          __atomic_load_n(t.requestedBits + w, __ATOMIC_RELAXED));
+        counts.loaded += __builtin_popcountll(
+          __atomic_load_n(t.loadedBits + w, __ATOMIC_RELAXED));
+      }
+    }
+    counts.bytesRead = source ? source->bytesRead.load() : 0;
+    return counts;
+  }
+
+  /*! bricks requested but not loaded yet, from the residency bitsets,
+      so requests no loader has picked up yet count as well; in an
+      attached process these are the owner's bits */
+  size_t numPendingBricks() const
+  {
+    size_t pending = 0;
+    for (const BrickTree<N, T> &t : tree) {
+      const size_t numWords = (t.numValueBricks + 63) / 64;
+      for (size_t w = 0; w < numWords; w++)
+        pending += __builtin_popcountll(
+          __atomic_load_n(t.requestedBits + w, __ATOMIC_RELAXED)
+          & ~__atomic_load_n(t.loadedBits + w, __ATOMIC_RELAXED));
+    }
+    return pending;
+  }
+
+  /*! write the bricks loaded right now, with their level, to a
+      residency snapshot; returns how many */
+  size_t saveResidency(const std::string &fileName) const
+  {
+    std::vector<PrefetchBrick> bricks;
+    for (size_t treeID = 0; treeID < tree.size(); treeID++) {
+      const BrickTree<N, T> &t = tree[treeID];
+      if (!t.opened())
+        continue;
+      for (int level = 0; level < t.depth; level++)
+        for (size_t j = 0; j < t.vbIdxByLevelStride[level]; j++) {
+          const size_t brickID = t.vbIdxByLevelBuffers[level][j];
+          if (t.isLoaded(brickID))
+            bricks.push_back({int(treeID), int(brickID), level});
+        }
+    }
+
+    const ResidencySnapshotHeader header =
+      ResidencySnapshotHeader::make(tree.size(), N, sizeof(T), bricks.size());
+    FILE *file = fopen(fileName.c_str(), "wb");
+    if (!file)
+      throw std::runtime_error("could not write residency snapshot "
+                               + fileName);
+    const bool ok =
+      fwrite(&header, sizeof(header), 1, file) == 1
+      && fwrite(bricks.data(), sizeof(PrefetchBrick), bricks.size(), file)
+         == bricks.size();
+    if (fclose(file) != 0 || !ok) {
+      remove(fileName.c_str());
+      throw std::runtime_error("could not write residency snapshot "
+                               + fileName);
+    }
+    return bricks.size();
+  }
+
+  /*! load every brick of a residency snapshot that is not resident
+      yet, before the first frame asks for them; the bricks of a tree
+      are read in file order, runs of them with one read. returns the
+      number of bricks loaded (or requested, in a process attached to a
+      shared arena), 0 if there is no snapshot for this forest */
+  size_t loadResidency(const std::string &fileName)
+  {
+    FILE *file = fopen(fileName.c_str(), "rb");
+    if (!file)
+      return 0;
+    ResidencySnapshotHeader header;
+    std::vector<PrefetchBrick> bricks;
+    const bool valid =
+      fread(&header, sizeof(header), 1, file) == 1
+      && header.sameForest(ResidencySnapshotHeader::make(tree.size(), N,
+                                                         sizeof(T), 0));
+    if (valid) {
+      bricks.resize(header.numBricks);
+      bricks.resize(fread(bricks.data(), sizeof(PrefetchBrick),
+                          bricks.size(), file));
+    }
+    fclose(file);
+    if (!valid) {
+      std::cout << "#osp: ignoring residency snapshot " << fileName
+                << " of a different forest" << std::endl;
+      return 0;
+    }
+
+    std::sort(bricks.begin(), bricks.end(),
+              [](const PrefetchBrick &a, const PrefetchBrick &b) {
+                return a.treeID < b.treeID ||
+                  (a.treeID == b.treeID && a.brickID < b.brickID);
+              });
+    std::vector<size_t> treeBegin;
+    for (size_t i = 0; i < bricks.size(); i++)
+      if (i == 0 || bricks[i].treeID != bricks[i - 1].treeID)
+        treeBegin.push_back(i);
+    treeBegin.push_back(bricks.size());
+
+    std::atomic<size_t> numLoaded{0};
+    tasking::parallel_for(treeBegin.size() - 1, [&](size_t i)
+    {
+      const int treeID = bricks[treeBegin[i]].treeID;
+      if (treeID < 0 || size_t(treeID) >= tree.size() || !isResident(treeID))
+        return;
+      BrickTree<N, T> &t = tree[treeID];
+      std::vector<int> vbs;
+      for (size_t b = treeBegin[i]; b < treeBegin[i + 1]; b++) {
+        const int brickID = bricks[b].brickID;
+        if (brickID >= 0 && size_t(brickID) < t.numValueBricks
+            && !t.isLoaded(brickID) && (vbs.empty() || vbs.back() != brickID))
+          vbs.push_back(brickID);
+      }
+      if (vbs.empty())
+        return;
+      numLoaded += vbs.size();
+      if (!arena.isOwner()) {
+        // the owner's loaders open the tree and read them
+        for (int brickID : vbs)
+          t.request(brickID);
+        t.request(0);
+        return;
+      }
+      openTree(treeID);
+      t.loadTreeByBrick(*source, treeID, vbs);
+      // requested only once loaded, so the loaders leave them alone
+      for (int brickID : vbs)
+        t.request(brickID);
+    });
+    if (numLoaded > 0)
+      residencyGeneration++;
+    return numLoaded;
+  }
+
+  /*! ask the loaders for a brick as if a sampler had needed it; the
+      tree is opened first if it was not yet */
+  void requestBrick(size_t treeID, size_t brickID)
+  {
+    if (!isResident(treeID) || brickID >= tree[treeID].numValueBricks)
+      return;
+    tree[treeID].request(brickID);
+    tree[treeID].request(0);
+  }
+
+  void loadPrefetchedBricks(const FileName &brickFileBase)
+  {
+    std::vector<PrefetchBrick> batch;
+    {
+      std::lock_guard<std::mutex> lock(prefetchMtx);
+      const size_t end = std::min(prefetchNext + prefetchBatchSize,
+                                  prefetchQueue.size());
+      batch.assign(prefetchQueue.begin() + prefetchNext,
+                   prefetchQueue.begin() + end);
+      prefetchNext = end;
+    }
+    if (batch.empty())
+      return;
+
+    std::sort(batch.begin(), batch.end(),
+              [](const PrefetchBrick &a, const PrefetchBrick &b) {
+                return a.treeID < b.treeID ||
+                  (a.treeID == b.treeID && a.brickID < b.brickID);
+              });
+
+    for (size_t begin = 0; begin < batch.size();) {
+      const int treeID = batch[begin].treeID;
+      std::vector<int> vbs;
+      // a brick the renderer asked for in the meantime is shown as
+      // soon as it lands, so its load has to be announced like a
+      // demand load
+      bool demanded = false;
+      size_t end = begin;
+      for (; end < batch.size() && batch[end].treeID == treeID; end++) {
+        const int vbID = batch[end].brickID;
+        if (tree[treeID].isLoaded(vbID))
+          continue;
+        demanded |= tree[treeID].isRequested(vbID);
+        vbs.emplace_back(batch[end].brickID);
+      }
+      if (!vbs.empty()) {
+        openTree(treeID);
+        tree[treeID].loadTreeByBrick(*source, treeID, vbs);
+        if (demanded)
+          residencyGeneration++;
+      }
+      begin = end;
+    }
+  }
+
+  /*! loader loop; with NUMA_PARTITION a loader only serves the trees
+      placed on its own node ('node' < 0 serves all trees) */
+  void loadTreeBrick(const FileName &brickFileBase, int node = -1)
   {
 #if 0
     //Stream by bricktree.
@@ -328,7 +1785,7 @@ struct BrickTreeForest
     //     needLoad      = tree[i].isTreeNeedLoad();
     //     if (needLoad)
     //     {
-    //       tree[i].loadTreeByBrick(brickFileBase, i);
+    //       tree[i].loadTreeByBrick(*source, i);
     //     }
     //   }
     // }
@@ -339,29 +1796,44 @@ struct BrickTreeForest
       for (size_t i = 0; i < tree.size(); i++) {
         std::vector<vec2i> vbReqList =getReqVBs(tree[i]);
         if (!vbReqList.empty())
-          tree[i].loadTreeByBrick(brickFileBase, i, vbReqList);
+          tree[i].loadTreeByBrick(*source, i, vbReqList);
       }
     }
 
 #else 
     //Stream by tree level. performance to be optimized
 
-    while (!tree.empty()) {
-      for (int i = 0; i < depth; i++) {
+    while (!stopLoaders) {
+      for (int i = 0; i < depth && !stopLoaders; i++) {
         tasking::parallel_for(tree.size(), [&](size_t treeID)
         {
+          if (stopLoaders)
+            return;
+          if ((node >= 0 && treeNode[treeID] != node) || !isResident(treeID))
+            return;
+          // the renderer asks for a tree by requesting its root brick
+          if (!tree[treeID].opened()) {
+            if (!tree[treeID].isRequested(0))
+              return;
+            openTree(treeID);
+          }
           size_t *curLevelVBs = tree[treeID].vbIdxByLevelBuffers[i];
           size_t numVBs = tree[treeID].vbIdxByLevelStride[i];
           std::vector<int> reqVBs;
           for (size_t j = 0; j < numVBs; j++) {
             size_t vbIdx = curLevelVBs[j];
-            if (!tree[treeID].valueBricksStatus[vbIdx].isLoaded &&
-              tree[treeID].valueBricksStatus[vbIdx].isRequested)
+            if (tree[treeID].needsLoad(vbIdx))
               reqVBs.emplace_back(vbIdx);
           }
-          tree[treeID].loadTreeByBrick(brickFileBase, treeID, reqVBs);
+          if (reqVBs.empty())
+            return;
+          tree[treeID].loadTreeByBrick(*source, treeID, reqVBs);
+          residencyGeneration++;
         });
       }
+      loadPrefetchedBricks(brickFileBase);
+      if (sharedHeader)
+        sharedHeader->generation = residencyGeneration.load();
     }
 
     //while (!tree.empty()) {
@@ -404,6 +1876,211 @@ struct BrickTreeForest
 #endif
   }
 
+  /*! read a tree's index into its arena slices; safe to call from any
+      thread, the first caller does the work */
+  void openTree(size_t treeID)
+  {
+    BrickTree<N, T> &t = tree[treeID];
+    if (t.opened() || !isResident(treeID))
+      return;
+    if (!arena.isOwner()) {
+      // the owner of the shared arena reads the index; ask and wait
+      t.request(0);
+      for (int i = 0; !__atomic_load_n(&sharedOpen[treeID], __ATOMIC_ACQUIRE);
+           i++) {
+        if (i % 100 == 0 && (sharedOwnerLost || !ownerAlive()))
+          throw std::runtime_error("owner of shared brick arena "
+                                   + placement.sharedName
+                                   + " is gone, cannot open tree "
+                                   + std::to_string(treeID));
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      adoptTree(treeID);
+      return;
+    }
+    std::lock_guard<std::mutex> lock(openMtx[treeID % 64]);
+    if (t.opened())
+      return;
+    t.mapIndex(*source, treeID);
+    t.reorganizeValueBrickBufferByLevel(levelEntries + t.firstValueBrick);
+    t.markOpened();
+    if (sharedOpen)
+      __atomic_store_n(&sharedOpen[treeID], 1, __ATOMIC_RELEASE);
+  }
+
+  /*! stamp (as its owner) or check (as an attacher) the header of a
+      shared arena; false if the segment was left by a process that died */
+  bool attachShared(size_t headerOfs, size_t openOfs, size_t arenaBytes)
+  {
+    const uint32_t numTrees = forestSize.product();
+    sharedHeader = arena.at<SharedHeader>(headerOfs);
+    sharedOpen   = arena.at<uint8_t>(openOfs);
+    if (arena.isOwner()) {
+      memset(sharedOpen, 0, numTrees);
+      sharedHeader->arenaBytes    = arenaBytes;
+      sharedHeader->numTrees      = numTrees;
+      sharedHeader->ownerPid      = getpid();
+      sharedHeader->ready         = 0;
+      sharedHeader->generation    = 0;
+      // the magic goes last, attachers wait for it
+      std::atomic_thread_fence(std::memory_order_release);
+      memcpy(sharedHeader->magic, "BTSHARE", 8);
+      return true;
+    }
+    for (int i = 0; memcmp(sharedHeader->magic, "BTSHARE", 8) != 0; i++) {
+      if (i == 10000)
+        return false;
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    std::atomic_thread_fence(std::memory_order_acquire);
+    if (!ownerAlive())
+      return false;
+    if (sharedHeader->arenaBytes != arenaBytes
+        || sharedHeader->numTrees != numTrees)
+      throw std::runtime_error("shared brick arena " + placement.sharedName
+                               + " holds a different forest");
+    return true;
+  }
+
+  bool ownerAlive() const
+  {
+    return kill(sharedHeader->ownerPid, 0) == 0 || errno != ESRCH;
+  }
+
+  /*! take over a tree the owner of the shared arena opened */
+  void adoptTree(size_t treeID)
+  {
+    BrickTree<N, T> &t = tree[treeID];
+    std::lock_guard<std::mutex> lock(openMtx[treeID % 64]);
+    if (t.opened())
+      return;
+    t.adoptValueBrickBufferByLevel(levelEntries + t.firstValueBrick);
+    t.markOpened();
+  }
+
+  /*! runs in processes attached to a shared arena instead of the
+      loaders: adopts the trees the owner opened and forwards its
+      residency changes to this process' clients. stops once the owner
+      is gone: what is resident stays usable, but nothing is loaded
+      any more, so pending requests are never served */
+  void followSharedArena()
+  {
+    uint64_t generation = sharedHeader->generation;
+    for (int i = 0; !stopLoaders; i++) {
+      if (i % 100 == 0 && !ownerAlive()) {
+        sharedOwnerLost = true;
+        std::cerr << "#osp: owner of shared brick arena "
+                  << placement.sharedName
+                  << " exited, no more bricks will be loaded" << std::endl;
+        return;
+      }
+      for (size_t treeID = 0; treeID < tree.size(); treeID++)
+        if (!tree[treeID].opened()
+            && __atomic_load_n(&sharedOpen[treeID], __ATOMIC_ACQUIRE))
+          adoptTree(treeID);
+      const uint64_t current = sharedHeader->generation;
+      if (current != generation) {
+        generation = current;
+        residencyGeneration++;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  }
+
+  std::string manifestFileName() const
+  {
+    return bt::manifestFileName(brickFileBase);
+  }
+
+  BrickTreeManifestHeader manifestHeader() const
+  {
+    return BrickTreeManifestHeader::make(forestSize.product(), N, sizeof(T));
+  }
+
+  /*! the manifest next to the trees' files if they are not local, e.g.
+      behind an object store; false if there is none */
+  bool readRemoteManifest(const BrickTreeManifestHeader &expected,
+                          std::vector<BrickTreeManifestEntry> &entries)
+  {
+    if (dynamic_cast<FileBrickSource *>(source.get()))
+      return false;
+    try {
+      const std::string name = FileName(manifestFileName()).base();
+      return readManifestFile(source->localPath(name), expected, entries);
+    } catch (const std::runtime_error &) {
+      return false;
+    }
+  }
+
+  /*! whether every tree's .ospbin is still the one its entry was made
+      for; trees whose source cannot stamp them are trusted */
+  bool manifestMatchesFiles(const std::vector<BrickTreeManifestEntry> &entries)
+  {
+    std::atomic<bool> matches{true};
+    tasking::parallel_for(int(entries.size()), [&](int treeID)
+    {
+      uint64_t bytes;
+      int64_t mtime;
+      if (source->fileStamp(source->treeFile(treeID, "ospbin"), bytes, mtime)
+          && !manifestEntryMatches(entries[treeID], N, sizeof(T), bytes,
+                                   mtime))
+        matches = false;
+    });
+    return matches;
+  }
+
+  /*! fill in every tree's manifest entry. the manifest is a single
+      binary file next to the trees; if it is missing, does not match
+      this forest or trees were rebuilt since, it is built from the
+      per-tree .osp files once and written back for the next run */
+  void readManifest()
+  {
+    const int numTrees = forestSize.product();
+    const BrickTreeManifestHeader expected = manifestHeader();
+    std::vector<BrickTreeManifestEntry> entries(numTrees);
+
+    if ((readManifestFile(manifestFileName(), expected, entries)
+         || readRemoteManifest(expected, entries))
+        && manifestMatchesFiles(entries)) {
+      for (int i = 0; i < numTrees; i++)
+        tree[i].setManifestEntry(entries[i]);
+      return;
+    }
+    if (FILE *stale = fopen(manifestFileName().c_str(), "rb")) {
+      fclose(stale);
+      std::cout << "#osp: ignoring stale manifest " << manifestFileName()
+                << std::endl;
+    }
+
+    // a rank only scans the trees it holds; the others stay zero sized
+    // and the manifest is left to a process that sees the whole forest
+    bool complete = true;
+    for (int treeID = 0; treeID < numTrees; treeID++)
+      complete &= isResident(treeID);
+    tasking::parallel_for(numTrees, [&](int treeID)
+    {
+      if (!isResident(treeID))
+        return;
+      tree[treeID].mapOSP(*source, treeID, treeCoord(treeID));
+      entries[treeID] = tree[treeID].manifestEntry();
+      uint64_t bytes;
+      int64_t mtime;
+      if (source->fileStamp(source->treeFile(treeID, "ospbin"), bytes, mtime)) {
+        entries[treeID].binBytes = bytes;
+        entries[treeID].binMTime = mtime;
+      }
+    });
+    if (!complete)
+      return;
+
+    // the forest opens without one, only slower next time
+    try {
+      writeManifestFile(manifestFileName(), expected, entries);
+    } catch (const std::runtime_error &e) {
+      std::cout << "#osp: " << e.what() << std::endl;
+    }
+  }
+
   void Initialize()
   {
     ospray::time_point t1 = ospray::Time();
@@ -412,27 +2089,164 @@ struct BrickTreeForest
 
     tree.resize(numTrees);
 
-    std::mutex amutex;
-    tasking::parallel_for(numTrees, [&](int treeID)
-    {
-      vec3i treeCoord = vec3i(treeID % forestSize.x,
-                              (treeID / forestSize.x) % forestSize.y,
-                              treeID / (forestSize.x * forestSize.y));
-      BrickTree<N, T> aTree;
-      aTree.mapOSP(brickFileBase, treeID, treeCoord);
+    // pass 1: size the arena from the manifest; trees themselves are
+    // only opened once something samples or prefetches them
+    readManifest();
 
+    // trees of other ranks keep their manifest entry (value range and
+    // average) but get no bricks
+    for (int treeID = 0; treeID < numTrees; treeID++) {
+      if (isResident(treeID))
+        continue;
+      tree[treeID].numValueBricks = 0;
+      tree[treeID].numIndexBricks = 0;
+      tree[treeID].numBrickInfos  = 0;
+      tree[treeID].depth          = 0;
+    }
+
+    // lay the trees out region by region, so a value brick is addressed
+    // by its 64-bit global ID from a single base pointer
+    typedef BrickTree<N, T> Tree;
+    size_t numVBs = 0, numIBs = 0, numInfos = 0, numWords = 0, numLevels = 0;
+    for (auto &t : tree) {
+      t.firstValueBrick = numVBs;
+      numVBs    += t.numValueBricks;
+      numIBs    += t.numIndexBricks;
+      numInfos  += t.numBrickInfos;
+      numWords  += treeBitsWords(t);
+      numLevels += t.depth;
+      valueRange.x = min(valueRange.x, t.valueRange.x);
+      valueRange.y = max(valueRange.y, t.valueRange.y);
+    }
+
+    BrickArena::Layout layout;
+    const size_t headerOfs    = layout.add(sizeof(SharedHeader));
+    const size_t openOfs      = layout.add(numTrees);
+    const size_t vbOfs        = layout.add(numVBs * sizeof(typename Tree::ValueBrick));
+    const size_t ibOfs        = layout.add(numIBs * sizeof(typename Tree::IndexBrick));
+    const size_t infoOfs      = layout.add(numInfos * sizeof(typename Tree::BrickInfo));
+    const size_t requestedOfs = layout.add(numWords * sizeof(uint64_t));
+    const size_t loadedOfs    = layout.add(numWords * sizeof(uint64_t));
+    const size_t entriesOfs   = layout.add(numVBs * sizeof(size_t));
+    const size_t stridesOfs   = layout.add(numLevels * sizeof(size_t));
+    arena = BrickArena(layout, placement);
+    if (isShared() && !attachShared(headerOfs, openOfs, layout.size)) {
+      if (placement.attachOnly)
+        throw std::runtime_error("owner of shared brick arena "
+                                 + placement.sharedName + " died");
+      // the segment was left behind by a process that died
+      std::cout << "#osp: replacing stale shared brick arena "
+                << placement.sharedName << std::endl;
+      arena = BrickArena();
+      BrickArena::removeShared(placement.sharedName);
+      arena = BrickArena(layout, placement);
+      if (!attachShared(headerOfs, openOfs, layout.size))
+        throw std::runtime_error("could not set up shared brick arena "
+                                 + placement.sharedName);
+    }
+    // the placement policy has to be in place before the pages are
+    // first touched by clearing or by the loader threads; in a shared
+    // arena that is up to its owner
+    const bool owner = arena.isOwner();
+    if (!owner) {
+      // attachers run no loaders, so the trees' nodes are never used
+      treeNode.assign(numTrees, 0);
+    } else if (placement.numa == BrickArena::NUMA_INTERLEAVE) {
+      arena.interleave(0, layout.size);
+    } else if (placement.numa == BrickArena::NUMA_PARTITION) {
+      // contiguous runs of trees with about the same number of value
+      // bricks per node; the small index and bit regions are read by
+      // every render thread and get interleaved
+      const int nodes = BrickArena::numNumaNodes();
+      treeNode.resize(numTrees);
+      for (int node = 0, treeID = 0; node < nodes; node++) {
+        const size_t end = (numVBs * (node + 1)) / nodes;
+        const int first = treeID;
+        while (treeID < numTrees &&
+               (node == nodes - 1 || tree[treeID].firstValueBrick < end))
+          treeNode[treeID++] = node;
+        if (treeID == first)
+          continue;
+        const size_t lo = tree[first].firstValueBrick;
+        const size_t hi = tree[treeID - 1].firstValueBrick
+                          + tree[treeID - 1].numValueBricks;
+        arena.place(vbOfs + lo * sizeof(typename Tree::ValueBrick),
+                    (hi - lo) * sizeof(typename Tree::ValueBrick), node);
+      }
+      arena.interleave(ibOfs, layout.size - ibOfs);
+    }
+    if (owner) {
+      arena.clear(requestedOfs, numWords * sizeof(uint64_t));
+      arena.clear(loadedOfs, numWords * sizeof(uint64_t));
+    }
+
+    valueBricks = arena.at<typename Tree::ValueBrick>(vbOfs);
+    levelBuffers.assign(numLevels, nullptr);
+    size_t ib = 0, info = 0, words = 0, levelOfs = 0;
+    for (auto &t : tree) {
+      t.valueBrick    = valueBricks + t.firstValueBrick;
+      t.indexBrick    = arena.at<typename Tree::IndexBrick>(ibOfs) + ib;
+      t.brickInfo     = arena.at<typename Tree::BrickInfo>(infoOfs) + info;
+      t.requestedBits = arena.at<uint64_t>(requestedOfs) + words;
+      t.loadedBits    = arena.at<uint64_t>(loadedOfs) + words;
+      t.vbIdxByLevelBuffers = levelBuffers.data() + levelOfs;
+      t.vbIdxByLevelStride  = arena.at<size_t>(stridesOfs) + levelOfs;
+      ib       += t.numIndexBricks;
+      info     += t.numBrickInfos;
+      words    += treeBitsWords(t);
+      levelOfs += t.depth;
+    }
+
+    levelEntries = arena.at<size_t>(entriesOfs);
+    // anything resident may be visible until the volume's first
+    // transfer function says otherwise
+    treeVisible.resize(numTrees);
+    for (int i = 0; i < numTrees; i++)
+      treeVisible[i] = treeResidence[i] != TREE_ABSENT;
+    this->levels = BrickLevelTable(N, blockWidth());
+    buildTreeNeighbors();
 #if !(STREAM_DATA)
-      aTree.mapOspBin(brickFileBase, treeID);
+    // pass 2: without streaming everything is read up front
+    if (owner) {
+      tasking::parallel_for(numTrees, [&](int treeID)
+      {
+        if (!isResident(treeID))
+          return;
+        openTree(treeID);
+        tree[treeID].mapOspBin(*source, treeID);
+      });
+    }
 #endif
-      tree[treeID] = aTree;
-      valueRange.x = min(valueRange.x, aTree.valueRange.x);
-      valueRange.y = max(valueRange.y, aTree.valueRange.y);
-    });
 
-    tasking::parallel_for(numTrees, [&](int treeID)
-    {
-      tree[treeID].reorganizeValueBrickBufferByLevel();
-    });
+    if (sharedHeader && owner) {
+      sharedHeader->ready = 1;
+    } else if (sharedHeader) {
+      // wait for the owner to be set up (and, without streaming, to have
+      // read everything), then take over what it opened so far
+      while (!sharedHeader->ready) {
+        if (!ownerAlive())
+          throw std::runtime_error("owner of shared brick arena "
+                                   + placement.sharedName + " died");
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+      }
+      for (int treeID = 0; treeID < numTrees; treeID++)
+        if (__atomic_load_n(&sharedOpen[treeID], __ATOMIC_ACQUIRE))
+          adoptTree(treeID);
+    }
+
+    // the voxels covered by this rank's own trees
+    box3i owned(forestSize, vec3i(0));
+    for (int treeID = 0; treeID < numTrees; treeID++) {
+      if (treeResidence[treeID] != TREE_OWNED)
+        continue;
+      owned.lower = min(owned.lower, treeCoord(treeID));
+      owned.upper = max(owned.upper, treeCoord(treeID) + vec3i(1));
+    }
+    if (reduce_min(owned.upper - owned.lower) <= 0)
+      forestBounds = box3f(vec3f(0.f), vec3f(0.f));
+    else
+      forestBounds = box3f(vec3f(min(owned.lower * blockWidth(), originalVolumeSize)),
+                           vec3f(min(owned.upper * blockWidth(), originalVolumeSize)));
 
     printf("#osp: %d trees have initialized! Timespan:%lf\n", numTrees, ospray::Time(t1));
   }
@@ -440,35 +2254,78 @@ struct BrickTreeForest
   void loadBrickTreeForest()
   {
     // set another thread to load the binary data.(*.ospbin)
+    // with a numa placement the loaders are spread over the nodes and
+    // pinned there, so the bricks they read land in local caches first;
+    // partitioned forests additionally split the trees between them as
+    // long as every node gets a loader
+    const int nodes = BrickArena::numNumaNodes();
+    const bool pin = placement.numa != BrickArena::NUMA_NONE && nodes > 1;
+    const bool split = pin && placement.numa == BrickArena::NUMA_PARTITION
+                       && nodes <= (int)numThread;
     for (size_t i = 0; i < numThread; i++) {
+      const int node = i % nodes;
       loadBrickTreeThread[i] = std::thread(
-        [&](const FileName &filebase)
-        { loadTreeBrick(filebase); },
+        [&, node, split](const FileName &filebase)
+        { loadTreeBrick(filebase, split ? node : -1); },
         this->brickFileBase);
-      loadBrickTreeThread[i].detach();
+      if (pin)
+        BrickArena::pinToNode(loadBrickTreeThread[i], node);
     }
   }
 
   BrickTreeForest(const vec3i &forestSize,
                   const vec3i &originalVolumeSize,
                   const int &depth,
-                  const FileName &brickFileBase)
+                  const FileName &brickFileBase,
+                  const BrickArena::Placement &placement = BrickArena::Placement(),
+                  const std::vector<uint8_t> &treeResidence = std::vector<uint8_t>(),
+                  std::shared_ptr<BrickSource> source = nullptr)
     : forestSize(forestSize),
       originalVolumeSize(originalVolumeSize),
       depth(depth),
       brickFileBase(brickFileBase),
+      source(source ? source : BrickSource::open(brickFileBase.str())),
       valueRange(vec2f(std::numeric_limits<float>::infinity(),
-                       -std::numeric_limits<float>::infinity()))
+                       -std::numeric_limits<float>::infinity())),
+      placement(placement),
+      treeResidence(treeResidence)
   {
+    // without a partition every tree is this process' own
+    if (this->treeResidence.empty())
+      this->treeResidence.assign(forestSize.product(), TREE_OWNED);
+    if (this->treeResidence.size() != size_t(forestSize.product()))
+      throw std::runtime_error("BrickTreeForest: residence given for "
+                               + std::to_string(this->treeResidence.size())
+                               + " trees, forest has "
+                               + std::to_string(forestSize.product()));
     Initialize();
     PRINT(valueRange);
+    if (!arena.isOwner()) {
+      // the owner's loaders serve this process' requests
+      followThread = std::thread(&BrickTreeForest::followSharedArena, this);
+      return;
+    }
 #if STREAM_DATA
     loadBrickTreeForest();
 #endif
   }
 
+  /*! stop the loaders (or the follower) for good; requests made
+      afterwards are never served. the threads read the trees, bitsets
+      and arena until they return */
+  void stopLoading()
+  {
+    stopLoaders = true;
+    for (std::thread &t : loadBrickTreeThread)
+      if (t.joinable())
+        t.join();
+    if (followThread.joinable())
+      followThread.join();
+  }
+
   ~BrickTreeForest()
   {
+    stopLoading();
     tree.clear();
   }
 
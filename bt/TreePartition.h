@@ -0,0 +1,306 @@
+// ======================================================================== //
+// Copyright 2009-2017 Intel Corporation                                    //
+//                                                                          //
+// Licensed under the Apache License, Version 2.0 (the "License");          //
+// you may not use this file except in compliance with the License.         //
+// You may obtain a copy of the License at                                  //
+//                                                                          //
+//     http://www.apache.org/licenses/LICENSE-2.0                           //
+//                                                                          //
+// Unless required by applicable law or agreed to in writing, software      //
+// distributed under the License is distributed on an "AS IS" BASIS,        //
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied. //
+// See the License for the specific language governing permissions and      //
+// limitations under the License.                                           //
+// ======================================================================== //
+
+#pragma once
+
+// ospcommon
+#include "ospcommon/box.h"
+#include "ospcommon/vec.h"
+// std
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace ospray {
+namespace bt
+{
+
+using namespace ospcommon;
+
+/*! what a rank holds of a tree of the forest */
+enum TreeResidence : uint8_t
+{
+  TREE_ABSENT = 0, // never opened, samples as its average
+  TREE_OWNED  = 1, // rendered by this rank
+  TREE_GHOST  = 2  // owned by a neighbor rank, only read for interpolation
+};
+
+/*! assignment of the trees of a forest's root grid to ranks for data
+    parallel rendering. every rank owns one box of trees, so the data of
+    a rank is convex and the distributed framebuffer can composite the
+    ranks' images in visibility order */
+struct TreePartition
+{
+  //! size of the root grid, in trees
+  vec3i gridSize;
+  //! per rank its box of trees, [lower,upper); empty if it owns none
+  std::vector<box3i> rankBox;
+
+  /*! split the root grid into 'numRanks' boxes of (about) equal cost by
+      recursive bisection along the longest axis. 'treeCost' holds one
+      cost per tree in forest order; without it every tree costs the same */
+  static TreePartition kdSplit(const vec3i &gridSize, int numRanks,
+                               const std::vector<double> &treeCost =
+                                 std::vector<double>())
+  {
+    if (numRanks < 1)
+      throw std::runtime_error("TreePartition: need at least one rank, got "
+                               + std::to_string(numRanks));
+    if (!treeCost.empty() && treeCost.size() != size_t(gridSize.product()))
+      throw std::runtime_error("TreePartition: got costs for "
+                               + std::to_string(treeCost.size())
+                               + " trees, grid has "
+                               + std::to_string(gridSize.product()));
+    TreePartition p;
+    p.gridSize = gridSize;
+    p.rankBox.resize(numRanks);
+    std::vector<double> cost(treeCost);
+    if (cost.empty())
+      cost.assign(size_t(gridSize.product()), 1.);
+    p.split(box3i(vec3i(0), gridSize), 0, numRanks, cost);
+    return p;
+  }
+
+  /*! read a partition written by save() */
+  static TreePartition load(const std::string &fileName)
+  {
+    std::ifstream in(fileName);
+    if (!in)
+      throw std::runtime_error("could not open partition file " + fileName);
+    TreePartition p;
+    p.gridSize = vec3i(0);
+    std::string line, key;
+    int numRanks = -1;
+    while (std::getline(in, line)) {
+      if (line.empty() || line[0] == '#')
+        continue;
+      std::istringstream fields(line);
+      if (!(fields >> key))
+        continue;
+      if (key == "grid") {
+        fields >> p.gridSize.x >> p.gridSize.y >> p.gridSize.z;
+      } else if (key == "ranks") {
+        fields >> numRanks;
+        if (numRanks > 0)
+          p.rankBox.resize(numRanks);
+      } else if (key == "rank") {
+        int r = -1;
+        box3i b;
+        fields >> r >> b.lower.x >> b.lower.y >> b.lower.z
+               >> b.upper.x >> b.upper.y >> b.upper.z;
+        if (!fields || r < 0 || r >= p.numRanks())
+          throw std::runtime_error("bad line in partition file " + fileName
+                                   + ": " + line);
+        p.rankBox[r] = b;
+      } else {
+        throw std::runtime_error("unknown key '" + key
+                                 + "' in partition file " + fileName);
+      }
+    }
+    if (numRanks < 1 || reduce_min(p.gridSize) < 1)
+      throw std::runtime_error("incomplete partition file " + fileName);
+
+    // every tree has exactly one owner: boxes inside the grid, pairwise
+    // disjoint, and together as large as the grid
+    size_t covered = 0;
+    for (int r = 0; r < p.numRanks(); r++) {
+      const box3i &b = p.rankBox[r];
+      if (isEmpty(b))
+        continue;
+      if (reduce_min(b.lower) < 0 || b.upper.x > p.gridSize.x
+          || b.upper.y > p.gridSize.y || b.upper.z > p.gridSize.z)
+        throw std::runtime_error("partition file " + fileName + ": rank "
+                                 + std::to_string(r)
+                                 + " has trees outside the grid");
+      for (int o = 0; o < r; o++)
+        if (!isEmpty(p.rankBox[o]) && overlap(b, p.rankBox[o]))
+          throw std::runtime_error("partition file " + fileName
+                                   + ": ranks " + std::to_string(o) + " and "
+                                   + std::to_string(r) + " share trees");
+      const vec3i extent = b.upper - b.lower;
+      covered += size_t(extent.x) * extent.y * extent.z;
+    }
+    if (covered != size_t(p.gridSize.product()))
+      throw std::runtime_error("partition file " + fileName + " assigns "
+                               + std::to_string(covered) + " of "
+                               + std::to_string(p.gridSize.product())
+                               + " trees");
+    return p;
+  }
+
+  /*! write the partition as text, one box of trees per rank */
+  void save(const std::string &fileName) const
+  {
+    std::ofstream out(fileName);
+    if (!out)
+      throw std::runtime_error("could not write partition file " + fileName);
+    out << "# bricktree partition: rank lower.xyz upper.xyz (in trees)\n"
+        << "grid " << gridSize.x << " " << gridSize.y << " " << gridSize.z
+        << "\nranks " << numRanks() << "\n";
+    for (int r = 0; r < numRanks(); r++) {
+      const box3i &b = rankBox[r];
+      out << "rank " << r << " "
+          << b.lower.x << " " << b.lower.y << " " << b.lower.z << " "
+          << b.upper.x << " " << b.upper.y << " " << b.upper.z << "\n";
+    }
+  }
+
+  /*! sum of the tree costs of each rank */
+  std::vector<double> rankCost(const std::vector<double> &treeCost) const
+  {
+    std::vector<double> result(numRanks(), 0.);
+    for (int r = 0; r < numRanks(); r++)
+      result[r] = boxCost(rankBox[r], treeCost);
+    return result;
+  }
+
+  /*! predicted load imbalance: the most expensive rank's cost over the
+      average, 1 for a perfect split */
+  double imbalance(const std::vector<double> &treeCost) const
+  {
+    const std::vector<double> cost = rankCost(treeCost);
+    double total = 0., most = 0.;
+    for (double c : cost) {
+      total += c;
+      most = std::max(most, c);
+    }
+    return total > 0. ? most * numRanks() / total : 1.;
+  }
+
+  int numRanks() const
+  { return (int)rankBox.size(); }
+
+  /*! rank owning the tree at root grid cell 'c' */
+  int owner(const vec3i &c) const
+  {
+    for (int r = 0; r < numRanks(); r++)
+      if (contains(rankBox[r], c))
+        return r;
+    return -1;
+  }
+
+  /*! per tree (in forest order): whether 'rank' owns it, needs it as a
+      ghost because it touches one of the rank's trees, or never reads it */
+  std::vector<uint8_t> residence(int rank) const
+  {
+    std::vector<uint8_t> result(size_t(gridSize.product()), TREE_ABSENT);
+    const box3i &own = rankBox[rank];
+    if (isEmpty(own))
+      return result;
+    const vec3i lo = max(vec3i(0), own.lower - vec3i(1));
+    const vec3i hi = min(gridSize, own.upper + vec3i(1));
+    for (int z = lo.z; z < hi.z; z++)
+      for (int y = lo.y; y < hi.y; y++)
+        for (int x = lo.x; x < hi.x; x++)
+          result[x + size_t(gridSize.x) * (y + size_t(gridSize.y) * z)] =
+            contains(own, vec3i(x, y, z)) ? TREE_OWNED : TREE_GHOST;
+    return result;
+  }
+
+  /*! the part of the volume 'rank' renders, in voxels; empty if the
+      rank owns no tree */
+  box3f region(int rank, int blockWidth, const vec3i &volumeSize) const
+  {
+    const box3i &own = rankBox[rank];
+    if (isEmpty(own))
+      return box3f(vec3f(0.f), vec3f(0.f));
+    return box3f(vec3f(min(own.lower * blockWidth, volumeSize)),
+                 vec3f(min(own.upper * blockWidth, volumeSize)));
+  }
+
+private:
+  static bool isEmpty(const box3i &b)
+  {
+    return b.upper.x <= b.lower.x || b.upper.y <= b.lower.y
+           || b.upper.z <= b.lower.z;
+  }
+
+  static bool contains(const box3i &b, const vec3i &c)
+  {
+    return c.x >= b.lower.x && c.y >= b.lower.y && c.z >= b.lower.z
+           && c.x < b.upper.x && c.y < b.upper.y && c.z < b.upper.z;
+  }
+
+  static bool overlap(const box3i &a, const box3i &b)
+  {
+    return a.lower.x < b.upper.x && b.lower.x < a.upper.x
+           && a.lower.y < b.upper.y && b.lower.y < a.upper.y
+           && a.lower.z < b.upper.z && b.lower.z < a.upper.z;
+  }
+
+  double boxCost(const box3i &b, const std::vector<double> &treeCost) const
+  {
+    double sum = 0.;
+    for (int z = b.lower.z; z < b.upper.z; z++)
+      for (int y = b.lower.y; y < b.upper.y; y++)
+        for (int x = b.lower.x; x < b.upper.x; x++)
+          sum += treeCost[x + size_t(gridSize.x) * (y + size_t(gridSize.y) * z)];
+    return sum;
+  }
+
+  void split(const box3i &box, int firstRank, int count,
+             const std::vector<double> &treeCost)
+  {
+    const vec3i extent = box.upper - box.lower;
+    int axis = 0;
+    if (extent.y > extent[axis]) axis = 1;
+    if (extent.z > extent[axis]) axis = 2;
+    if (count == 1 || extent[axis] < 2) {
+      // a single tree cannot be shared: surplus ranks stay empty
+      rankBox[firstRank] = box;
+      for (int r = firstRank + 1; r < firstRank + count; r++)
+        rankBox[r] = box3i(box.lower, box.lower);
+      return;
+    }
+
+    // cut where the slabs below come closest to the left ranks' share
+    std::vector<double> slab(extent[axis], 0.);
+    double total = 0.;
+    for (int i = 0; i < extent[axis]; i++) {
+      box3i s = box;
+      s.lower[axis] = box.lower[axis] + i;
+      s.upper[axis] = box.lower[axis] + i + 1;
+      slab[i] = boxCost(s, treeCost);
+      total += slab[i];
+    }
+    const int left = count / 2;
+    const double target = total * left / count;
+    int cut = 1;
+    double below = slab[0], bestError = std::abs(below - target);
+    for (int i = 2; i < extent[axis]; i++) {
+      below += slab[i - 1];
+      const double error = std::abs(below - target);
+      if (error < bestError) {
+        bestError = error;
+        cut = i;
+      }
+    }
+
+    box3i lo = box, hi = box;
+    lo.upper[axis] = box.lower[axis] + cut;
+    hi.lower[axis] = box.lower[axis] + cut;
+    split(lo, firstRank, left, treeCost);
+    split(hi, firstRank + left, count - left, treeCost);
+  }
+};
+
+}  // namespace bt
+}  // namespace ospray
@@ -28,6 +28,7 @@
 #define VECTORIZE 1
 #define SAMPLE_EACH_POINT 0
 #define EMPTY_SPACE_SKIP 1
+#define WAVEFRONT_SAMPLING 1
 
 #define INVALID_BRICKID -1
 
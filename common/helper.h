@@ -54,6 +54,25 @@ namespace ospray
     writePPM(fileName.c_str(), sizex, sizey, pixel);
   }
 
+  ///////////////////////////////////////////////////////// 
+  // Morton (Z-order) codes, used to sort queries into a
+  // brick coherent order before traversing the forest
+  ////////////////////////////////////////////////////////
+  inline uint64_t expandBits3(uint64_t v)
+  {
+    v &= 0x1fffff; // 21 bits per axis
+    v = (v | v << 32) & 0x1f00000000ffffull;
+    v = (v | v << 16) & 0x1f0000ff0000ffull;
+    v = (v | v << 8)  & 0x100f00f00f00f00full;
+    v = (v | v << 4)  & 0x10c30c30c30c30c3ull;
+    v = (v | v << 2)  & 0x1249249249249249ull;
+    return v;
+  }
+  inline uint64_t mortonCode3(uint32_t x, uint32_t y, uint32_t z)
+  {
+    return expandBits3(x) | (expandBits3(y) << 1) | (expandBits3(z) << 2);
+  }
+
   ///////////////////////////////////////////////////////// 
   // Runtime Measurement 
   ////////////////////////////////////////////////////////
@@ -28,6 +28,7 @@
 // ispc exports
 #include "BrickTreeVolume_ispc.h"
 // stl
+#include <algorithm>
 #include <map>
 #include <math.h>
 #include <set>
@@ -47,6 +48,9 @@ namespace ospray {
           validSize(-1),
           depth(0),
           brickSize(-1),
+          lodBias(1.f),
+          rank(0),
+          numRanks(1),
           fileName("<none>")
     {
     }
@@ -59,20 +63,153 @@ namespace ospray {
             "They can only be set from existing data");
     }
 
-    int BrickTreeVolume::getBlockID(const vec3f &pos)
+    int BrickTreeVolume::getBlockID(const vec3f &pos) const
     {
       // vec3i blockIdx = (pos * validSize) / blockWidth;
       // return blockIdx.x + blockIdx.y * gridSize.x +
       //        blockIdx.z * gridSize.y * gridSize.x;
-      int xDim = pos.x / blockWidth;  //(pos.x <= blockWidth) ? 0 : 1;
-      int yDim = pos.y / blockWidth;  //(pos.y <= blockWidth) ? 0 : 1;
-      int zDim = pos.z / blockWidth;  //(pos.z <= blockWidth) ? 0 : 1;
-      xDim = (xDim >= gridSize.x) ? gridSize.x - 1 : xDim;
-      yDim = (yDim >= gridSize.y) ? gridSize.y - 1 : yDim;
-      zDim = (zDim >= gridSize.z) ? gridSize.z - 1 : zDim;
+      const vec3i blockIdx = levels.treePos(max(vec3i(0), vec3i(pos)));
+      const int xDim = min(blockIdx.x, gridSize.x - 1);
+      const int yDim = min(blockIdx.y, gridSize.y - 1);
+      const int zDim = min(blockIdx.z, gridSize.z - 1);
       return xDim + yDim * gridSize.x + zDim * gridSize.y * gridSize.x;
     }
 
+    void BrickTreeVolume::computeSamples(float **results,
+                                         const vec3f *worldCoordinates,
+                                         const size_t &count)
+    {
+#if WAVEFRONT_SAMPLING
+      *results = (float *)malloc(count * sizeof(float));
+      if (*results == nullptr)
+        throw std::runtime_error("BrickTree: error allocating sample buffer");
+      if (count == 0)
+        return;
+
+      // sort key: tree ID in the high bits, morton code of the finest
+      // brick in the low 36 bits (BrickLevelTable::sortKey). samples
+      // whose interpolation corners straddle two or more trees get the
+      // key of a virtual tree past the end of the forest, so they end up
+      // in one trailing bin
+      const uint64_t boundaryTree = gridSize.product();
+      std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+      tasking::parallel_for(count, [&](size_t i) {
+        const vec3f &p  = worldCoordinates[i];
+        const vec3i lo  = max(vec3i(0), min(validSize - 1, vec3i(p)));
+        const vec3i hi  = max(vec3i(0), min(validSize - 1, vec3i(p) + 1));
+        const int treeLo = getBlockID(vec3f(lo));
+        const int treeHi = getBlockID(vec3f(hi));
+        const uint64_t tree = (treeLo == treeHi) ? treeLo : boundaryTree;
+        keys[i] = std::make_pair(levels.sortKey(tree, lo), (uint32_t)i);
+      });
+      std::sort(keys.begin(), keys.end());
+
+      // SoA queues of the sorted positions, and one bin per tree
+      std::vector<float> xs(count), ys(count), zs(count), values(count);
+      std::vector<int> binTree, binBegin;
+      for (size_t i = 0; i < count; i++) {
+        const vec3f &p = worldCoordinates[keys[i].second];
+        xs[i] = p.x;
+        ys[i] = p.y;
+        zs[i] = p.z;
+        const uint64_t tree = keys[i].first >> 36;
+        if (i == 0 || tree != (keys[i - 1].first >> 36)) {
+          binTree.push_back(tree == boundaryTree ? -1 : (int)tree);
+          binBegin.push_back((int)i);
+        }
+      }
+      binBegin.push_back((int)count);
+
+      ispc::BrickTreeVolume_sampleBins(getIE(),
+                                       xs.data(), ys.data(), zs.data(),
+                                       values.data(),
+                                       binTree.data(), binBegin.data(),
+                                       (int)binTree.size());
+
+      for (size_t i = 0; i < count; i++)
+        (*results)[keys[i].second] = values[i];
+#else
+      Volume::computeSamples(results, worldCoordinates, count);
+#endif
+    }
+
+    void BrickTreeVolume::sampleMany(const vec3f *pos, float *values,
+                                     size_t count, int maxLevel) const
+    {
+      if (!sampler || count == 0)
+        return;
+      // same order as the wavefront sampler: by tree, then by the morton
+      // code of the finest brick, so each chunk walks few bricks
+      std::vector<std::pair<uint64_t, uint32_t>> keys(count);
+      tasking::parallel_for(count, [&](size_t i) {
+        const vec3i lo = max(vec3i(0), min(validSize - 1, vec3i(pos[i])));
+        const uint64_t tree = getBlockID(vec3f(lo));
+        keys[i] = std::make_pair(levels.sortKey(tree, lo), (uint32_t)i);
+      });
+      std::sort(keys.begin(), keys.end());
+
+      std::vector<vec3f> sorted(count);
+      std::vector<float> results(count);
+      for (size_t i = 0; i < count; i++)
+        sorted[i] = pos[keys[i].second];
+      const size_t chunkSize = 1024;
+      const size_t numChunks = (count + chunkSize - 1) / chunkSize;
+      tasking::parallel_for(numChunks, [&](size_t chunk) {
+        const size_t begin = chunk * chunkSize;
+        const size_t end   = std::min(count, begin + chunkSize);
+        ispc::BrickTreeVolume_sampleMany(getIE(),
+                                         (const ispc::vec3f *)&sorted[begin],
+                                         &results[begin], (int)(end - begin),
+                                         std::min(maxLevel, depth));
+      });
+      for (size_t i = 0; i < count; i++)
+        values[keys[i].second] = results[i];
+    }
+
+    void BrickTreeVolume::benchSample(const vec3f *pos, float *values,
+                                      size_t count)
+    {
+      ispc::BrickTreeVolume_sampleBatch(getIE(), (const ispc::vec3f *)pos,
+                                        values, (int)count);
+    }
+
+    void BrickTreeVolume::benchGradient(const vec3f *pos, vec3f *gradients,
+                                        size_t count)
+    {
+      ispc::BrickTreeVolume_gradientBatch(getIE(), (const ispc::vec3f *)pos,
+                                          (ispc::vec3f *)gradients,
+                                          (int)count);
+    }
+
+    size_t BrickTreeVolume::benchStepRays(const vec3f *org, const vec3f *dir,
+                                          const vec2f *tRange, size_t count,
+                                          float step)
+    {
+      return ispc::BrickTreeVolume_stepRays(getIE(),
+                                            (const ispc::vec3f *)org,
+                                            (const ispc::vec3f *)dir,
+                                            (const ispc::vec2f *)tRange,
+                                            (int)count, step);
+    }
+
+    void BrickTreeVolume::updateLOD(float fovy)
+    {
+      // a brick of width w at distance t covers roughly
+      // PI*(0.5*w*pixelsPerUnit/t)^2 pixels; stop refining once that
+      // drops below one pixel. lodBias widens the tolerated footprint
+      const float pixelsPerUnit =
+        imageSize.y / (2.f * tanf(deg2rad(0.5f * fovy)) * lodBias);
+      std::vector<float> lod(depth);
+      float brickW = blockWidth;
+      for (int l = 0; l < depth; l++) {
+        lod[l] = 0.5f * brickW * pixelsPerUnit * sqrtf(float(M_PI));
+        brickW /= brickSize;
+      }
+      ispc::BrickTreeVolume_set_LOD(getIE(), lod.data(), depth);
+      std::lock_guard<std::mutex> lock(lodMtx);
+      lodDistance.swap(lod);
+    }
+
     /*! callback function called by ispc sampling code to compute a
       gradient at given sample pos in this (c++-only) module */
     extern "C" float BrickTree_scalar_sample(ScalarVolumeSampler *cppSampler,
@@ -118,9 +255,83 @@ namespace ospray {
     }
 
 
+    BrickTreeVolume::~BrickTreeVolume()
+    {
+      listenToTransferFunction(nullptr);
+      delete sampler;
+    }
+
+    void BrickTreeVolume::listenToTransferFunction(ManagedObject *tfn)
+    {
+      if (tfn == listenedTransferFunction)
+        return;
+      if (listenedTransferFunction) {
+        listenedTransferFunction->unregisterListener(this);
+        listenedTransferFunction->refDec();
+      }
+      listenedTransferFunction = tfn;
+      if (tfn) {
+        tfn->refInc();
+        tfn->registerListener(this);
+      }
+    }
+
+    void BrickTreeVolume::dependencyGotChanged(ManagedObject *object)
+    {
+      Volume::dependencyGotChanged(object);
+      // the transfer function changed: trees may have become (in)visible
+      if (ispcEquivalent && sampler)
+        ispc::BrickTreeVolume_updateTreeVisibility(getIE());
+    }
+
     //! Allocate storage and populate the volume.
+    std::vector<std::pair<std::string, std::string>>
+    BrickTreeVolume::forestParams()
+    {
+      auto str = [](const vec3i &v) {
+        return std::to_string(v.x) + " " + std::to_string(v.y) + " "
+          + std::to_string(v.z);
+      };
+      return {
+        {"gridSize",      str(getParam3i("gridSize", vec3i(-1)))},
+        {"brickSize",     std::to_string(getParam1i("brickSize", -1))},
+        {"blockWidth",    std::to_string(getParam1i("blockWidth", -1))},
+        {"validSize",     str(getParam3i("validSize", vec3i(-1)))},
+        {"fileName",      getParamString("fileName", "")},
+        {"format",        getParamString("format", "<not specified>")},
+        {"hugePages",     std::to_string(getParam1i("hugePages", 0) != 0)},
+        {"numaPolicy",    getParamString("numaPolicy", "none")},
+        {"sharedMemory",  getParamString("sharedMemory", "")},
+        {"brickServer",   getParamString("brickServer", "")},
+        {"brickUrl",      getParamString("brickUrl", "")},
+        {"brickCache",    getParamString("brickCache", "")},
+        {"residencyFile", getParamString("residencyFile", "")},
+        {"numRanks",      std::to_string(getParam1i("numRanks", 1))},
+        {"rank",          std::to_string(getParam1i("rank", 0))},
+        {"partitionFile", getParamString("partitionFile", "")}
+      };
+    }
+
     void BrickTreeVolume::commit()
     {
+      // the forest is only opened once; later commits (e.g. LOD updates
+      // from an interactive session) may only change lodBias, imageSize,
+      // renderThreshold, the camera and the transfer function. check
+      // before any member is overwritten, so a rejected commit leaves
+      // the volume as it was
+      if (sampler) {
+        const auto params = forestParams();
+        for (size_t i = 0; i < params.size(); i++)
+          if (params[i].second != openedForestParams[i].second)
+            throw std::runtime_error("BrickTree: parameter '"
+                                     + params[i].first
+                                     + "' can't change once the forest is"
+                                       " opened (was '"
+                                     + openedForestParams[i].second
+                                     + "', now '" + params[i].second
+                                     + "'); create a new volume instead");
+      }
+
       // create IE
       if (ispcEquivalent == nullptr)
         ispcEquivalent = ispc::BrickTreeVolume_create(this);
@@ -136,15 +347,57 @@ namespace ospray {
       PerspectiveCamera* camera = (PerspectiveCamera*)getParamObject("camera", nullptr);
       this->validFractionOfRootGrid = 
         vec3f(validSize) / vec3f(gridSize*blockWidth);
-      this->depth = (int)(log(blockWidth)/log(brickSize));
+      // all coordinate decomposition goes through shifts and masks, so
+      // both widths have to be powers of two
+      this->levels = BrickLevelTable(brickSize, blockWidth);
+      this->depth  = levels.depth;
       this->renderThreshold = getParam1f("renderThreshold", 0.0f);
+      this->imageSize = getParam2i("imageSize", vec2i(1024, 768));
+      this->lodBias = max(1.f, getParam1f("lodBias", 1.f));
+
+      // brick memory placement, only used when the forest is opened
+      this->placement.hugePages = getParam1i("hugePages", 0) != 0;
+      const std::string numa = getParamString("numaPolicy", "none");
+      if (numa == "interleave")
+        this->placement.numa = BrickArena::NUMA_INTERLEAVE;
+      else if (numa == "partition")
+        this->placement.numa = BrickArena::NUMA_PARTITION;
+      else if (numa == "none")
+        this->placement.numa = BrickArena::NUMA_NONE;
+      else
+        throw std::runtime_error("BrickTree: unknown numaPolicy '" + numa + "'");
+      // processes opening a forest under the same name share its bricks
+      this->placement.sharedName = getParamString("sharedMemory", "");
+      if (!placement.sharedName.empty() && placement.sharedName[0] != '/')
+        placement.sharedName = "/" + placement.sharedName;
+      // or take them from a brick server, which names the segment
+      this->brickServer = getParamString("brickServer", "");
+      // where the trees' files are read from
+      this->brickUrl   = getParamString("brickUrl", "");
+      this->brickCache = getParamString("brickCache", "");
+      // bricks a previous run saved, preloaded when the forest is opened
+      this->residencyFile = getParamString("residencyFile", "");
+
+      // tree ownership, only used when the forest is opened
+      this->numRanks = max(1, getParam1i("numRanks", 1));
+      this->rank     = getParam1i("rank", 0);
+      this->partitionFile = getParamString("partitionFile", "");
+      if (rank < 0 || rank >= numRanks)
+        throw std::runtime_error("BrickTree: rank " + std::to_string(rank)
+                                 + " out of range for "
+                                 + std::to_string(numRanks) + " ranks");
 
-      this->sampler = createSampler();
+      if (!sampler) {
+        this->sampler = createSampler();
+        openedForestParams = forestParams();
+      }
       ispc::BrickTreeVolume_set(getIE(),
                                 (ispc::vec3i &)validSize,
                                 (ispc::vec3i &)gridSize,
                                 brickSize,
                                 blockWidth,
+                                levels.log2N,
+                                levels.shift,
                                 renderThreshold,
                                 this,
                                 sampler);
@@ -154,22 +407,42 @@ namespace ospray {
                                             (ispc::vec3f *)&camera->dir,
                                             (ispc::vec3f *)&camera->pos,
                                             &camera->fovy);
+      updateLOD(camera->fovy);
 
       if(brickSize == 2){
-        auto & forest = dynamic_cast<BrickTreeForestSampler<float, 2> *>(sampler)->forest->tree;
-        ispc::BrickTreeVolume_set_BricktreeForest(getIE(), forest.data(), forest.size());
+        auto &forest = dynamic_cast<BrickTreeForestSampler<float, 2> *>(sampler)->forest;
+        ispc::BrickTreeVolume_set_BricktreeForest(getIE(), forest->tree.data(),
+                                                  forest->tree.size(),
+                                                  forest->valueBricks,
+                                                  forest->treeVisible.data(),
+                                                  forest->treeNeighbors.data(),
+                                                  forest->treeResidence.data());
       }
 
       if(brickSize == 4){
-        auto & forest = dynamic_cast<BrickTreeForestSampler<float, 4> *>(sampler)->forest->tree;
-        ispc::BrickTreeVolume_set_BricktreeForest(getIE(), forest.data(), forest.size());
+        auto &forest = dynamic_cast<BrickTreeForestSampler<float, 4> *>(sampler)->forest;
+        ispc::BrickTreeVolume_set_BricktreeForest(getIE(), forest->tree.data(),
+                                                  forest->tree.size(),
+                                                  forest->valueBricks,
+                                                  forest->treeVisible.data(),
+                                                  forest->treeNeighbors.data(),
+                                                  forest->treeResidence.data());
       }
 
       if(brickSize == 8){
-        auto &forest = dynamic_cast<BrickTreeForestSampler<float, 8> *>(sampler)->forest->tree;
-        ispc::BrickTreeVolume_set_BricktreeForest(getIE(), forest.data(), forest.size());
+        auto &forest = dynamic_cast<BrickTreeForestSampler<float, 8> *>(sampler)->forest;
+        ispc::BrickTreeVolume_set_BricktreeForest(getIE(), forest->tree.data(),
+                                                  forest->tree.size(),
+                                                  forest->valueBricks,
+                                                  forest->treeVisible.data(),
+                                                  forest->treeNeighbors.data(),
+                                                  forest->treeResidence.data());
       }
 
+      // whole-tree culling has to follow the transfer function
+      listenToTransferFunction(getParamObject("transferFunction", nullptr));
+      ispc::BrickTreeVolume_updateTreeVisibility(getIE());
+
       // std::cout << "[cpp]  sizeof(BrickTree) " 
       //           << sizeof(BrickTree<4,float>) << std::endl;      
       // auto& forest = dynamic_cast<BrickTreeForestSampler<float,4>*>
@@ -50,11 +50,47 @@ namespace ospray {
      */
     struct ScalarVolumeSampler
     {
+      virtual ~ScalarVolumeSampler() = default;
+
       /*! compute sample at given position */
       virtual float sample(const vec3f &pos) const = 0;
 
       /*! compute gradient at given position */
       virtual vec3f computeGradient(const vec3f &pos) const = 0;
+
+      /*! compute 'count' samples at once, refining no deeper than
+          'maxLevel' (if the sampler supports a level of detail) */
+      virtual void sampleMany(const vec3f *pos, float *values, size_t count,
+                              int maxLevel = BrickLevelTable::maxLevels) const
+      {
+        for (size_t i = 0; i < count; i++)
+          values[i] = sample(pos[i]);
+      }
+
+      /*! residency generation of the underlying data, bumped whenever
+          newly requested bricks became resident */
+      virtual size_t residencyGeneration() const { return 0; }
+
+      /*! number of requested bricks not loaded yet */
+      virtual size_t numPendingBricks() const { return 0; }
+
+      /*! queue low-priority loads for the bricks a predicted view will
+          need, replacing any earlier prediction */
+      virtual void prefetch(const PrefetchView &view,
+                            const std::vector<float> &lodDistance) {}
+
+      /*! drop queued prefetch loads, e.g. when the prediction was wrong */
+      virtual void cancelPrefetch() {}
+
+      /*! write the resident bricks to a snapshot file / preload the
+          bricks of one; both return the number of bricks */
+      virtual size_t saveResidency(const std::string &fileName) const
+      { return 0; }
+      virtual size_t loadResidency(const std::string &fileName)
+      { return 0; }
+
+      /*! bricks requested / loaded and bytes read so far */
+      virtual BrickCounts brickCounts() const { return BrickCounts(); }
     };
 
     static std::mutex mtx;
@@ -69,6 +105,7 @@ namespace ospray {
     struct BrickTreeVolume : public ospray::Volume
     {
       BrickTreeVolume();
+      virtual ~BrickTreeVolume() override;
 
       //! \brief common function to help printf-debugging
       virtual std::string toString() const
@@ -79,16 +116,86 @@ namespace ospray {
       //! Allocate storage and populate the volume.
       virtual void commit();
 
+      //! recompute the per-tree visibility when the transfer function
+      //  we registered with gets committed
+      virtual void dependencyGotChanged(ManagedObject *object) override;
+
       void updateBTForest();
 
+      //! rebuild the per-level LOD distance table for the given vertical
+      //  field of view (degrees) and the current image size
+      void updateLOD(float fovy);
+
       //! Copy voxels into the volume at the given index
       //  (non-zero return value indicates success).
       virtual int setRegion(const void *source,
                             const vec3i &index,
                             const vec3i &count) override;
 
+      //! Compute samples at the given world coordinates; with
+      //  WAVEFRONT_SAMPLING the positions are binned by tree and brick
+      //  before they are handed to the ispc sampler.
+      virtual void computeSamples(float **results,
+                                  const vec3f *worldCoordinates,
+                                  const size_t &count) override;
+
       //get the blockID in the bricktree volume
-      int getBlockID(const vec3f &pos);
+      int getBlockID(const vec3f &pos) const;
+
+      //! polled by progressive clients to reset accumulation when new
+      //  bricks arrived, and to stop rendering once nothing is pending
+      size_t residencyGeneration() const
+      { return sampler ? sampler->residencyGeneration() : 0; }
+      size_t numPendingBricks() const
+      { return sampler ? sampler->numPendingBricks() : 0; }
+
+      //! prefetch the bricks a predicted camera would need at the LOD
+      //  the current table assigns them; fovy is in degrees
+      void prefetch(const vec3f &pos, const vec3f &dir,
+                    float fovy, float aspect)
+      {
+        if (!sampler)
+          return;
+        // called from the viewer's thread while commit() may be
+        // replacing the table
+        std::vector<float> lod;
+        {
+          std::lock_guard<std::mutex> lock(lodMtx);
+          lod = lodDistance;
+        }
+        sampler->prefetch(PrefetchView{pos, dir, fovy, aspect}, lod);
+      }
+      void cancelPrefetch()
+      { if (sampler) sampler->cancelPrefetch(); }
+
+      //! residency snapshot of the forest, for the next run to preload
+      //  through the "residencyFile" parameter
+      size_t saveResidency(const std::string &fileName) const
+      { return sampler ? sampler->saveResidency(fileName) : 0; }
+
+      //! streaming totals, polled per frame by ospBrickBench's camera
+      //  path mode
+      BrickCounts brickCounts() const
+      { return sampler ? sampler->brickCounts() : BrickCounts(); }
+
+      //! batch sampling for c++ clients (probes, histograms, seeding)
+      //  that don't go through ospray's renderers: raw data values,
+      //  sorted by tree and brick and run through the ispc sampler in
+      //  parallel chunks; virtual as clients only get this module at
+      //  runtime
+      virtual void sampleMany(const vec3f *pos, float *values, size_t count,
+                              int maxLevel = BrickLevelTable::maxLevels) const;
+
+      //! the ispc sample / gradient / ray step kernels over a batch on
+      //  the calling thread, for ospBrickMicroBench; virtual as the
+      //  benchmark only gets this module at runtime. benchStepRays
+      //  returns the number of steps taken
+      virtual void benchSample(const vec3f *pos, float *values, size_t count);
+      virtual void benchGradient(const vec3f *pos, vec3f *gradients,
+                                 size_t count);
+      virtual size_t benchStepRays(const vec3f *org, const vec3f *dir,
+                                   const vec2f *tRange, size_t count,
+                                   float step);
 
       /*! create specialization of sampler for given type and brick size
        */
@@ -101,10 +208,22 @@ namespace ospray {
        *  an dtype
        */
       ScalarVolumeSampler *createSampler();
+      //! owned; deleting it stops the forest's loaders and frees its bricks
       ScalarVolumeSampler *sampler;
 
+      //! the parameters the forest is opened from, as (name, value)
+      //  strings, and their values at the commit that opened it; they
+      //  can't change afterwards
+      std::vector<std::pair<std::string, std::string>> forestParams();
+      std::vector<std::pair<std::string, std::string>> openedForestParams;
+
       bool finished = false;
 
+      //! the transfer function we listen to, with a reference held so it
+      //  can be unregistered from when it is replaced
+      ManagedObject *listenedTransferFunction = nullptr;
+      void listenToTransferFunction(ManagedObject *tfn);
+
       //! block size in each axis, e.g., 2x2x2
       vec3i gridSize;
       //! the original demension of the volume, e.g 512x512x512
@@ -117,8 +236,39 @@ namespace ospray {
       //! block with is acutally a brick tree width
       //! calculated by N^D x N^D x N^D
       int blockWidth;
+      //! per-level shifts/masks for blockWidth and brickSize
+      BrickLevelTable levels;
 
       float renderThreshold;
+
+      //! framebuffer size the LOD table is derived from
+      vec2i imageSize;
+      //! camera distance beyond which bricks on level l are not refined
+      std::vector<float> lodDistance;
+      //! guards lodDistance, which prefetch() reads from other threads
+      std::mutex lodMtx;
+      //! global LOD bias (>= 1) scaling the per-brick pixel tolerance;
+      //  raised by interactive clients to hold a target frame rate
+      float lodBias;
+
+      //! huge pages / numa placement of the forest's brick arena
+      BrickArena::Placement placement;
+      //! control socket of an ospBrickServer to take the bricks from;
+      //  the forest then attaches to the server's shared arena
+      std::string brickServer;
+      //! http url to read the trees' files from instead of the local
+      //  directory, and where to cache what was read
+      std::string brickUrl;
+      std::string brickCache;
+      //! residency snapshot to preload when the forest is opened
+      std::string residencyFile;
+
+      //! data parallel rendering: this rank only opens the trees it owns
+      //  (plus a ghost layer around them) out of 'numRanks' parts
+      int rank;
+      int numRanks;
+      //! tree-to-rank assignment to use; balanced from the manifest if empty
+      std::string partitionFile;
       
       std::string fileName;
 
@@ -139,8 +289,40 @@ namespace ospray {
       BrickTreeForestSampler(BrickTreeVolume *btv) : btv(btv)
       {
         //PING;
+        std::vector<uint8_t> residence;
+        if (btv->numRanks > 1)
+          residence = forestPartition(FileName(btv->fileName).dropExt(),
+                                      btv->gridSize, N, sizeof(T),
+                                      btv->numRanks, btv->partitionFile)
+                        .residence(btv->rank);
+        BrickArena::Placement placement = btv->placement;
+        std::shared_ptr<bt::BrickServerConnection> server;
+        if (!btv->brickServer.empty()) {
+          server = std::make_shared<bt::BrickServerConnection>(btv->brickServer);
+          const bt::BrickServerHello hello = server->hello();
+          if (hello.numTrees != uint32_t(btv->gridSize.product())
+              || hello.brickSize != N)
+            throw std::runtime_error("brick server at " + btv->brickServer
+                                     + " serves a different forest");
+          placement.sharedName = hello.sharedName;
+          placement.attachOnly = true;
+        }
+        std::shared_ptr<bt::BrickSource> source = bt::BrickSource::open(
+            FileName(btv->fileName).dropExt().str(), btv->brickUrl,
+            btv->brickCache);
         forest = std::make_shared<bt::BrickTreeForest<N, T>>(
-            btv->gridSize, btv->validSize,btv->depth, FileName(btv->fileName).dropExt());
+            btv->gridSize, btv->validSize,btv->depth, FileName(btv->fileName).dropExt(),
+            placement, residence, source);
+        forest->brickServer = server;
+
+        if (!btv->residencyFile.empty()) {
+          const ospray::time_point t0 = ospray::Time();
+          const size_t numBricks = forest->loadResidency(btv->residencyFile);
+          if (numBricks > 0)
+            std::cout << "#osp: preloaded " << numBricks << " bricks from "
+                      << btv->residencyFile << " in "
+                      << ospray::Time(t0) << " s" << std::endl;
+        }
 
         if(forest != NULL){
           btv->volBounds = forest->forestBounds;
@@ -151,38 +333,13 @@ namespace ospray {
       /*! compute sample at given position */
       virtual float sample(const vec3f &pos) const override
       {
-        // return 0.2f;
-
-        vec3f coord = pos;
-
-        vec3i low    = (vec3i)coord;
-        vec3f factor = coord - (vec3f)low;
-
-        float v;
-
-        float neighborValue[2][2][2];
-
-        array3D::for_each(vec3i(2), [&](const vec3i &idx) {
-          int blockId = btv->getBlockID((vec3f)(low + idx));
-          auto &bt    = forest->tree[blockId];
-          const vec3i samplePos = max(vec3i(0), min(btv->validSize - 1, low + idx));
-          neighborValue[idx.z][idx.y][idx.x] =
-              bt.findValue(blockId, samplePos, btv->blockWidth);
-        });
-
-        v = lerp3<float>(neighborValue[0][0][0],
-                         neighborValue[0][0][1],
-                         neighborValue[0][1][0],
-                         neighborValue[0][1][1],
-                         neighborValue[1][0][0],
-                         neighborValue[1][0][1],
-                         neighborValue[1][1][0],
-                         neighborValue[1][1][1],
-                         factor.x,
-                         factor.y,
-                         factor.z);
-
-        return v;
+        return forest->sample(pos);
+      }
+
+      virtual void sampleMany(const vec3f *pos, float *values, size_t count,
+                              int maxLevel) const override
+      {
+        forest->sampleMany(pos, values, count, maxLevel);
       }
 
       /*! compute gradient at given position */
@@ -192,6 +349,41 @@ namespace ospray {
         return vec3f(1, 0, 0);
       }
 
+      virtual size_t residencyGeneration() const override
+      {
+        return forest->residencyGeneration;
+      }
+
+      virtual size_t numPendingBricks() const override
+      {
+        return forest->numPendingBricks();
+      }
+
+      virtual void prefetch(const PrefetchView &view,
+                            const std::vector<float> &lodDistance) override
+      {
+        forest->prefetch(view, lodDistance);
+      }
+
+      virtual void cancelPrefetch() override
+      {
+        forest->cancelPrefetch();
+      }
+
+      virtual size_t saveResidency(const std::string &fileName) const override
+      {
+        return forest->saveResidency(fileName);
+      }
+
+      virtual size_t loadResidency(const std::string &fileName) override
+      {
+        return forest->loadResidency(fileName);
+      }
+
+      virtual BrickCounts brickCounts() const override
+      {
+        return forest->brickCounts();
+      }
 
 
       std::shared_ptr<bt::BrickTreeForest<N, T>> forest;